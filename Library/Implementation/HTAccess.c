@@ -265,6 +265,12 @@ static HTBool HTLoadDocument(
 		return HT_TRUE;
 	}
 
+	/* A safe point to collect unused anchors: callers hold only this one */
+	HTAnchor_keep((HTAnchor*) anchor);
+	HTAnchor_collectIfNeeded();
+	HTAnchor_unkeep((HTAnchor*) anchor);
+
+	HTAnchor_setLength(anchor, 0);    /* Until the protocol knows */
 	status = HTLoad(full_address, anchor, format_out, sink);
 
 
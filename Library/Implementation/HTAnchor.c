@@ -13,7 +13,11 @@
 **	(c) Copyright CERN 1991 - See Copyright.html
 */
 
-#define HASH_SIZE 101        /* Arbitrary prime. Memory/speed tradeoff */
+#define MIN_TABLE_SIZE 128    /* Power of 2. Doubled as anchors are added */
+#define CHILD_INDEX_MIN 8    /* Children before a parent gets an index */
+#define POOL_GRAIN 16        /* Size classes go up in these steps */
+#define POOL_MAX 256        /* Bigger things are malloc'ed */
+#define POOL_BLOCK 65536    /* Tunable */
 
 #include <HTSTD.h>
 #include <HTAnchor.h>
@@ -27,7 +31,108 @@ struct _HyperDoc {
 };
 #endif
 
-static HTList** adult_table = 0;  /* Point to table of lists of all parents */
+/*	All parent anchors are in a hash table of chains, linked through
+**	next_hash and keyed on the fingerprint of their canonical address.
+**	The table doubles whenever it holds more anchors than it has
+**	buckets, so chains stay short however many anchors there are.
+*/
+static HTParentAnchor** adult_table = 0;
+static unsigned long table_size = 0;    /* Power of 2 */
+static long table_count = 0;
+
+/*	The address of the parent whose links were last resolved, scanned
+**	once for all the links in its document.
+*/
+static HTParentAnchor* base_anchor = 0;
+static HTParseBase base;
+
+/*	Anchors, links, addresses and tags are small and there can be
+**	millions of them, so they are cut from big blocks rather than each
+**	being malloc'ed. Pieces are rounded up to a multiple of POOL_GRAIN,
+**	and freed ones are kept on a free list for their size.
+*/
+typedef union _HTPoolPiece HTPoolPiece;
+union _HTPoolPiece {
+	HTPoolPiece* next;        /* While on a free list */
+	char align[POOL_GRAIN];
+};
+
+static HTPoolPiece* pool_free[POOL_MAX / POOL_GRAIN];
+static char* pool_next = 0;    /* Rest of the current block */
+static char* pool_end = 0;
+static long pool_bytes = 0;    /* In blocks */
+static long pool_live = 0;    /* In pieces not freed */
+
+/*	Collection limits. 0 means no limit. After a collection the limit
+**	in force is at least twice what survived, so that a graph which is
+**	all live is not walked again on every load.
+*/
+long HTAnchorMaxCount = 0;
+long HTAnchorMaxBytes = 0;
+static long survived_count = 0;
+static long survived_bytes = 0;
+
+
+/*	Pooled allocation
+**	-----------------
+*/
+static void* pool_alloc(size_t size) {
+	size_t class = (size + POOL_GRAIN - 1) / POOL_GRAIN - 1;
+	HTPoolPiece* piece;
+
+	if(size > POOL_MAX) {
+		void* p = malloc(size);
+		if(p == NULL) HTOOM(__FILE__, "HTAnchor");
+		pool_live += size;
+		return p;
+	}
+	pool_live += (class + 1) * POOL_GRAIN;
+	if((piece = pool_free[class])) {
+		pool_free[class] = piece->next;
+		return piece;
+	}
+
+	size = (class + 1) * POOL_GRAIN;
+	if(pool_next + size > pool_end) {    /* The tail of the last is lost */
+		pool_next = malloc(POOL_BLOCK);
+		if(pool_next == NULL) HTOOM(__FILE__, "HTAnchor");
+		pool_end = pool_next + POOL_BLOCK;
+		pool_bytes += POOL_BLOCK;
+	}
+	piece = (HTPoolPiece*) pool_next;
+	pool_next += size;
+	return piece;
+}
+
+static void pool_release(void* p, size_t size) {
+	if(!p) return;
+	if(size > POOL_MAX) {
+		free(p);
+		pool_live -= size;
+	}
+	else {
+		size_t class = (size + POOL_GRAIN - 1) / POOL_GRAIN - 1;
+		HTPoolPiece* piece = p;
+		pool_live -= (class + 1) * POOL_GRAIN;
+		piece->next = pool_free[class];
+		pool_free[class] = piece;
+	}
+}
+
+static char* pool_string(const char* s) {
+	char* copy;
+	size_t size;
+
+	if(!s) return 0;
+	size = strlen(s) + 1;
+	copy = pool_alloc(size);
+	memcpy(copy, s, size);
+	return copy;
+}
+
+static void pool_release_string(char* s) {
+	if(s) pool_release(s, strlen(s) + 1);
+}
 
 /*				Creation Methods
 **				================
@@ -38,13 +143,16 @@ static HTList** adult_table = 0;  /* Point to table of lists of all parents */
 */
 
 static HTParentAnchor* HTParentAnchor_new(void) {
-	HTParentAnchor* newAnchor = calloc(1, sizeof(HTParentAnchor));
+	HTParentAnchor* newAnchor = pool_alloc(sizeof(HTParentAnchor));
+	memset(newAnchor, 0, sizeof(*newAnchor));
 	newAnchor->parent = newAnchor;
 	return newAnchor;
 }
 
 static HTChildAnchor* HTChildAnchor_new(void) {
-	return calloc(1, sizeof(HTChildAnchor));
+	HTChildAnchor* newAnchor = pool_alloc(sizeof(HTChildAnchor));
+	memset(newAnchor, 0, sizeof(*newAnchor));
+	return newAnchor;
 }
 
 
@@ -61,11 +169,11 @@ static HTChildAnchor* HTChildAnchor_new(void) {
 static HTBool equivalent(const char* s, const char* t) {
 	if(s && t) {  /* Make sure they point to something */
 		for(; *s && *t; s++, t++) {
-			if(toupper(*s) != toupper(*t)) {
+			if(toupper((unsigned char) *s) != toupper((unsigned char) *t)) {
 				return HT_FALSE;
 			}
 		}
-		return toupper(*s) == toupper(*t);
+		return toupper((unsigned char) *s) == toupper((unsigned char) *t);
 	}
 	else {
 		return s == t;
@@ -73,6 +181,172 @@ static HTBool equivalent(const char* s, const char* t) {
 }
 
 
+/*	Hash ignoring case
+**	------------------
+**
+**	FNV-1a over the upper case of each character, so that tags which
+**	are equivalent() have the same hash.
+*/
+static unsigned long hash_of(const char* s) {
+	unsigned long hash = 2166136261UL;
+
+	if(s) {
+		for(; *s; s++) {
+			hash ^= (unsigned long) toupper((unsigned char) *s);
+			hash = (hash * 16777619UL) & 0xffffffffUL;
+		}
+	}
+	return hash;
+}
+
+
+/*	Canonical form of an address
+**	----------------------------
+**
+**	In buffer if it fits, else malloc'ed.
+*/
+static char* canonical_address(const char* address, char* buffer, int size) {
+	int length = HTCanonicalInto(address, buffer, size);
+
+	if(length >= size) {
+		buffer = malloc(length + 1);
+		if(buffer == NULL) HTOOM(__FILE__, "HTAnchor_findAddress");
+		HTCanonicalInto(address, buffer, length + 1);
+	}
+	return buffer;
+}
+
+
+/*	Parent anchor table
+**	-------------------
+*/
+static void table_grow(void) {
+	unsigned long size = table_size ? table_size * 2 : MIN_TABLE_SIZE;
+	HTParentAnchor** table = calloc(size, sizeof(HTParentAnchor*));
+	unsigned long i;
+
+	if(table == NULL) HTOOM(__FILE__, "HTAnchor_findAddress");
+	for(i = 0; i < table_size; i++) {
+		HTParentAnchor* anchor = adult_table[i];
+		while(anchor) {
+			HTParentAnchor* next = anchor->next_hash;
+			HTParentAnchor** bucket =
+					&table[anchor->fingerprint.low & (size - 1)];
+			anchor->next_hash = *bucket;
+			*bucket = anchor;
+			anchor = next;
+		}
+	}
+	free(adult_table);
+	adult_table = table;
+	table_size = size;
+	if(TRACE) fprintf(stderr, "HTAnchor: Table now has %lu buckets\n", size);
+}
+
+static void table_add(HTParentAnchor* anchor) {
+	HTParentAnchor** bucket;
+
+	if((unsigned long) table_count >= table_size) table_grow();
+	bucket = &adult_table[anchor->fingerprint.low & (table_size - 1)];
+	anchor->next_hash = *bucket;
+	*bucket = anchor;
+	table_count++;
+}
+
+static void table_remove(HTParentAnchor* anchor) {
+	HTParentAnchor** p;
+
+	if(!adult_table) return;
+	for(p = &adult_table[anchor->fingerprint.low & (table_size - 1)]; *p;
+		p = &(*p)->next_hash) {
+		if(*p == anchor) {
+			*p = anchor->next_hash;
+			anchor->next_hash = 0;
+			table_count--;
+			return;
+		}
+	}
+}
+
+
+/*	Index of named children
+**	-----------------------
+**
+**	A parent with CHILD_INDEX_MIN or more children gets an open addressed
+**	hash table of the named ones, kept no more than half full. Children
+**	are only ever removed all together, so there are no deletions.
+*/
+static void child_index_put(HTParentAnchor* parent, HTChildAnchor* child) {
+	int mask = parent->child_slots - 1;
+	int slot;
+
+	for(slot = (int) (child->hash & mask); parent->child_index[slot];
+		slot = (slot + 1) & mask);
+	parent->child_index[slot] = child;
+	parent->child_count++;
+}
+
+static void child_index_resize(HTParentAnchor* parent, int slots) {
+	HTChildAnchor** old = parent->child_index;
+	int old_slots = parent->child_slots;
+	int i;
+
+	parent->child_index = calloc(slots, sizeof(HTChildAnchor*));
+	if(parent->child_index == NULL) HTOOM(__FILE__, "HTAnchor_findChild");
+	parent->child_slots = slots;
+	parent->child_count = 0;
+
+	if(old) {
+		for(i = 0; i < old_slots; i++) {
+			if(old[i]) child_index_put(parent, old[i]);
+		}
+		free(old);
+	}
+	else {
+		HTList* kids = parent->children;
+		HTChildAnchor* child;
+		while((child = HTList_nextObject(kids))) {
+			if(child->tag && *child->tag) child_index_put(parent, child);
+		}
+	}
+}
+
+static void child_index_add(HTParentAnchor* parent, HTChildAnchor* child) {
+	if(2 * (parent->child_count + 1) > parent->child_slots) {
+		child_index_resize(parent, parent->child_slots * 2);
+	}
+	child_index_put(parent, child);
+}
+
+static HTChildAnchor* find_child(
+		HTParentAnchor* parent, const char* tag, unsigned long hash) {
+	HTChildAnchor* child;
+
+	if(!parent->child_index &&
+	   HTList_count(parent->children) >= CHILD_INDEX_MIN) {
+		int slots = 4 * CHILD_INDEX_MIN;
+		while(slots < 2 * HTList_count(parent->children)) slots *= 2;
+		child_index_resize(parent, slots);
+	}
+
+	if(parent->child_index) {
+		int mask = parent->child_slots - 1;
+		int slot;
+		for(slot = (int) (hash & mask); (child = parent->child_index[slot]);
+			slot = (slot + 1) & mask) {
+			if(child->hash == hash && equivalent(child->tag, tag)) return child;
+		}
+	}
+	else {
+		HTList* kids = parent->children;
+		while((child = HTList_nextObject(kids))) {
+			if(child->hash == hash && equivalent(child->tag, tag)) return child;
+		}
+	}
+	return 0;
+}
+
+
 /*	Create new or find old sub-anchor
 **	---------------------------------
 **
@@ -82,24 +356,22 @@ static HTBool equivalent(const char* s, const char* t) {
 
 HTChildAnchor* HTAnchor_findChild(HTParentAnchor* parent, const char* tag) {
 	HTChildAnchor* child;
-	HTList* kids;
+	unsigned long hash = hash_of(tag);
 
 	if(!parent) {
 		if(TRACE) printf("HTAnchor_findChild called with NULL parent.\n");
 		return 0;
 	}
-	if((kids = parent->children)) {  /* parent has children : search them */
+	if(parent->children) {  /* parent has children : search them */
 		if(tag && *tag) {        /* TBL */
-			while((child = HTList_nextObject (kids))) {
-				if(equivalent(child->tag, tag)) { /* Case sensitive 920226 */
-					if(TRACE) {
-						fprintf(
-								stderr,
-								"Child anchor %p of parent %p with name `%s' already exists.\n",
-								(void*) child, (void*) parent, tag);
-					}
-					return child;
+			if((child = find_child(parent, tag, hash))) {
+				if(TRACE) {
+					fprintf(
+							stderr,
+							"Child anchor %p of parent %p with name `%s' already exists.\n",
+							(void*) child, (void*) parent, tag);
 				}
+				return child;
 			}
 		}  /*  end if tag is void */
 	}
@@ -115,7 +387,9 @@ HTChildAnchor* HTAnchor_findChild(HTParentAnchor* parent, const char* tag) {
 	} /* int for apollo */
 	HTList_addObject(parent->children, child);
 	child->parent = parent;
-	StrAllocCopy(child->tag, tag);
+	child->tag = pool_string(tag);
+	child->hash = hash;
+	if(parent->child_index && tag && *tag) child_index_add(parent, child);
 	return child;
 }
 
@@ -135,12 +409,28 @@ HTChildAnchor* HTAnchor_findChildAndLink(
 										) {
 	HTChildAnchor* child = HTAnchor_findChild(parent, tag);
 	if(href && *href) {
-		char* relative_to = HTAnchor_address((HTAnchor*) parent);
-		char* parsed_address = HTParse(href, relative_to, HT_PARSE_ALL);
-		HTAnchor* dest = HTAnchor_findAddress(parsed_address);
+		char buffer[256];    /* Most addresses fit: saves a malloc */
+		char* parsed_address = buffer;
+		HTAnchor* dest;
+		int length;
+
+		if(parent != base_anchor) {
+			HTParseSetBase(&base, parent->address ? parent->address : "");
+			base_anchor = parent;
+		}
+		length = HTParseRelative(
+				href, &base, HT_PARSE_ALL, buffer, sizeof(buffer));
+		if(length >= (int) sizeof(buffer)) {
+			parsed_address = malloc(length + 1);
+			if(parsed_address == NULL) {
+				HTOOM(__FILE__, "HTAnchor_findChildAndLink");
+			}
+			HTParseRelative(
+					href, &base, HT_PARSE_ALL, parsed_address, length + 1);
+		}
+		dest = HTAnchor_findAddress(parsed_address);
 		HTAnchor_link((HTAnchor*) child, dest, ltype);
-		free(parsed_address);
-		free(relative_to);
+		if(parsed_address != buffer) free(parsed_address);
 	}
 	return child;
 }
@@ -156,54 +446,64 @@ HTChildAnchor* HTAnchor_findChildAndLink(
 */
 
 HTAnchor* HTAnchor_findAddress(const char* address) {
-	char* tag = HTParse(
-			address, "", HT_PARSE_ANCHOR);  /* Anchor tag specified ? */
+	HTURLSpans spans;
+
+	HTParseSpans(address, &spans);    /* Anchor tag specified ? */
 
 	/* If the address represents a sub-anchor, we recursively load its parent,
 	   then we create a child anchor within that document. */
-	if(*tag) {
-		char* docAddress = HTParse(
-				address, "", HT_PARSE_ACCESS | HT_PARSE_HOST | HT_PARSE_PATH |
-							 HT_PARSE_PUNCTUATION);
-		HTParentAnchor* foundParent = (HTParentAnchor*) HTAnchor_findAddress(
-				docAddress);
-		HTChildAnchor* foundAnchor = HTAnchor_findChild(foundParent, tag);
-		free(docAddress);
-		free(tag);
+	if(spans.anchor.length > 0) {
+		char buffer[256];    /* Most addresses fit: saves a malloc */
+		char* docAddress = buffer;
+		char* tag = (char*) address + spans.anchor.start;
+		HTParentAnchor* foundParent;
+		HTChildAnchor* foundAnchor;
+		int wanted = HT_PARSE_ACCESS | HT_PARSE_HOST | HT_PARSE_PATH |
+					 HT_PARSE_PUNCTUATION;
+
+		if(HTParseInto(address, "", wanted, buffer, sizeof(buffer)) >=
+		   (int) sizeof(buffer)) {
+			docAddress = HTParse(address, "", wanted);
+		}
+		if(tag[spans.anchor.length]) {    /* Not the end of address */
+			tag = malloc(spans.anchor.length + 1);
+			if(tag == NULL) HTOOM(__FILE__, "HTAnchor_findAddress");
+			memcpy(tag, address + spans.anchor.start, spans.anchor.length);
+			tag[spans.anchor.length] = 0;
+		}
+
+		foundParent = (HTParentAnchor*) HTAnchor_findAddress(docAddress);
+		foundAnchor = HTAnchor_findChild(foundParent, tag);
+		if(docAddress != buffer) free(docAddress);
+		if(tag != address + spans.anchor.start) free(tag);
 		return (HTAnchor*) foundAnchor;
 	}
 
 	else { /* If the address has no anchor tag,
 	    check whether we have this node */
-		int hash;
-		const char* p;
-		HTList* adults;
-		HTList* grownups;
+		char buffer[256];
+		char* canonical = canonical_address(address, buffer, sizeof(buffer));
+		HTFingerprint fingerprint;
 		HTParentAnchor* foundAnchor;
 
-		free(tag);
-
-		/* Select list from hash table */
-		for(p = address, hash = 0; *p; p++) {
-			hash = (hash * 3 + (*(unsigned char*) p)) % HASH_SIZE;
-		}
-		if(!adult_table) {
-			adult_table = calloc(HASH_SIZE, sizeof(HTList*));
-		}
-		if(!adult_table[hash]) adult_table[hash] = HTList_new();
-		adults = adult_table[hash];
+		HTFingerprintOf(canonical, &fingerprint);
 
-		/* Search list for anchor */
-		grownups = adults;
-		while((foundAnchor = HTList_nextObject (grownups))) {
-			if(equivalent(foundAnchor->address, address)) {
-				if(TRACE) {
-					fprintf(
-							stderr,
-							"Anchor %p with address `%s' already exists.\n",
-							(void*) foundAnchor, address);
+		/* Search the bucket for the anchor */
+		if(adult_table) {
+			for(foundAnchor = adult_table[fingerprint.low & (table_size - 1)];
+				foundAnchor; foundAnchor = foundAnchor->next_hash) {
+				if(foundAnchor->fingerprint.low == fingerprint.low &&
+				   foundAnchor->fingerprint.high == fingerprint.high &&
+				   0 == strcmp(foundAnchor->address, canonical)) {
+					if(TRACE) {
+						fprintf(
+								stderr,
+								"Anchor %p with address `%s' already exists.\n",
+								(void*) foundAnchor, address);
+					}
+					if(canonical != buffer) free(canonical);
+					return (HTAnchor*) foundAnchor;
 				}
-				return (HTAnchor*) foundAnchor;
 			}
 		}
 
@@ -211,16 +511,49 @@ HTAnchor* HTAnchor_findAddress(const char* address) {
 		foundAnchor = HTParentAnchor_new();
 		if(TRACE) {
 			fprintf(
-					stderr, "New anchor %p has hash %d and address `%s'\n",
-					(void*) foundAnchor, hash, address);
+					stderr,
+					"New anchor %p has fingerprint %08lx%08lx and address `%s'\n",
+					(void*) foundAnchor, fingerprint.high, fingerprint.low,
+					canonical);
 		}
-		StrAllocCopy(foundAnchor->address, address);
-		HTList_addObject(adults, foundAnchor);
+		foundAnchor->address = pool_string(canonical);
+		foundAnchor->fingerprint = fingerprint;
+		table_add(foundAnchor);
+		if(canonical != buffer) free(canonical);
 		return (HTAnchor*) foundAnchor;
 	}
 }
 
 
+/*	How full the anchor tables are
+**	------------------------------
+*/
+void HTAnchor_stats(HTAnchorStats* stats) {
+	unsigned long i;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->parents = table_count;
+	stats->buckets = (long) table_size;
+	stats->pool_bytes = pool_bytes;
+	stats->live_bytes = pool_live;
+	for(i = 0; i < table_size; i++) {
+		HTParentAnchor* anchor;
+		long chain = 0;
+
+		for(anchor = adult_table[i]; anchor; anchor = anchor->next_hash) {
+			chain++;
+			if(anchor->child_index) {
+				stats->indexed_parents++;
+				stats->indexed_children += anchor->child_count;
+				stats->child_slots += anchor->child_slots;
+			}
+		}
+		if(chain) stats->used_buckets++;
+		if(chain > stats->longest_chain) stats->longest_chain = chain;
+	}
+}
+
+
 /*	Delete an anchor and possibly related things (auto garbage collection)
 **	--------------------------------------------
 **
@@ -239,6 +572,7 @@ static void deleteLinks(HTAnchor* me) {
 	/* Recursively try to delete target anchors */
 	if(me->mainLink.dest) {
 		HTParentAnchor* parent = me->mainLink.dest->parent;
+		me->mainLink.dest = 0;
 		HTList_removeObject(parent->sources, me);
 		if(!parent->document) {  /* Test here to avoid calling overhead */
 			HTAnchor_delete(parent);
@@ -252,15 +586,54 @@ static void deleteLinks(HTAnchor* me) {
 			if(!parent->document) {  /* Test here to avoid calling overhead */
 				HTAnchor_delete(parent);
 			}
+			pool_release(target, sizeof(HTLink));
 		}
+		HTList_delete(me->links);
+		me->links = 0;
+	}
+}
+
+/*	Free a parent anchor and its children
+**
+**	Their links must already be out of other anchors' source lists.
+*/
+static void free_links(HTAnchor* me) {
+	HTLink* target;
+
+	while((target = HTList_removeLastObject(me->links))) {
+		pool_release(target, sizeof(HTLink));
 	}
+	HTList_delete(me->links);
+}
+
+static void free_parent(HTParentAnchor* me) {
+	HTChildAnchor* child;
+
+	if(me == base_anchor) base_anchor = 0;
+
+	while((child = HTList_removeLastObject(me->children))) {
+		free_links((HTAnchor*) child);
+		pool_release_string(child->tag);
+		pool_release(child, sizeof(*child));
+	}
+	free_links((HTAnchor*) me);
+	free(me->child_index);
+	HTList_delete(me->children);
+	HTList_delete(me->sources);
+	HTList_delete(me->methods);
+	pool_release_string(me->address);
+	free(me->title);
+	free(me->physical);
+	/* Devise a way to clean out the HTFormat if no longer needed (ref count?) */
+	pool_release(me, sizeof(*me));
 }
 
 HTBool HTAnchor_delete(HTParentAnchor* me) {
 	HTChildAnchor* child;
+	HTList* kids;
 
-	/* Don't delete if document is loaded */
-	if(me->document) {
+	/* Don't delete if document is loaded or someone is keeping it */
+	if(me->document || me->keep) {
 		return HT_FALSE;
 	}
 
@@ -276,23 +649,161 @@ HTBool HTAnchor_delete(HTParentAnchor* me) {
 	}
 
 	/* No more incoming links : kill everything */
-	/* First, recursively delete children */
-	while((child = HTList_removeLastObject(me->children))) {
+	/* First, recursively delete children's links */
+	kids = me->children;
+	while((child = HTList_nextObject (kids)))
 		deleteLinks((HTAnchor*) child);
-		free(child->tag);
-		free(child);
-	}
 
 	/* Now kill myself */
-	HTList_delete(me->children);
-	HTList_delete(me->sources);
-	free(me->address);
-	/* Devise a way to clean out the HTFormat if no longer needed (ref count?) */
-	free(me);
+	table_remove(me);
+	free_parent(me);
 	return HT_TRUE;  /* Parent deleted */
 }
 
 
+/*	Keep an anchor from being collected
+**	-----------------------------------
+*/
+void HTAnchor_keep(HTAnchor* me) {
+	if(me) me->parent->keep++;
+}
+
+void HTAnchor_unkeep(HTAnchor* me) {
+	if(me && me->parent->keep > 0) me->parent->keep--;
+}
+
+
+/*	Collect anchors nothing can reach
+**	---------------------------------
+**
+**	Mark: every parent with a document or a keep count is live, and so
+**	is every parent which a live parent or one of its children links to.
+**	Sweep: the rest are taken out of the table, out of the source lists
+**	of live anchors, and freed.
+*/
+static HTParentAnchor** mark_stack = 0;
+static long mark_size = 0;
+static long mark_top = 0;
+
+static void mark(HTParentAnchor* me) {
+	if(me->marked) return;
+	me->marked = HT_TRUE;
+	if(mark_top == mark_size) {
+		mark_size = mark_size ? mark_size * 2 : 256;
+		mark_stack = realloc(mark_stack, mark_size * sizeof(HTParentAnchor*));
+		if(mark_stack == NULL) HTOOM(__FILE__, "HTAnchor_collect");
+	}
+	mark_stack[mark_top++] = me;
+}
+
+static void mark_links(HTAnchor* me) {
+	HTList* links = me->links;
+	HTLink* link;
+
+	if(me->mainLink.dest) mark(me->mainLink.dest->parent);
+	while((link = HTList_nextObject(links))) mark(link->dest->parent);
+}
+
+/*	Leave out sources whose parents are not marked, keeping the order
+*/
+static void prune_sources(HTParentAnchor* me) {
+	HTList* live;
+	int i;
+
+	for(i = HTList_count(me->sources) - 1; i >= 0; i--) {
+		HTAnchor* source = HTList_objectAt(me->sources, i);
+		if(!source->parent->marked) break;
+	}
+	if(i < 0) return;    /* Nothing to leave out */
+
+	live = HTList_new();
+	for(i = HTList_count(me->sources) - 1; i >= 0; i--) {
+		HTAnchor* source = HTList_objectAt(me->sources, i);
+		if(source->parent->marked) HTList_addObject(live, source);
+	}
+	HTList_delete(me->sources);
+	me->sources = live;
+}
+
+long HTAnchor_collect(void) {
+	HTParentAnchor* dead = 0;
+	HTParentAnchor* anchor;
+	long freed = 0;
+	unsigned long i;
+
+	for(i = 0; i < table_size; i++) {
+		for(anchor = adult_table[i]; anchor; anchor = anchor->next_hash) {
+			anchor->marked = HT_FALSE;
+		}
+	}
+	for(i = 0; i < table_size; i++) {
+		for(anchor = adult_table[i]; anchor; anchor = anchor->next_hash) {
+			if(anchor->document || anchor->keep) mark(anchor);
+		}
+	}
+	while(mark_top > 0) {
+		HTList* kids;
+		HTChildAnchor* child;
+
+		anchor = mark_stack[--mark_top];
+		mark_links((HTAnchor*) anchor);
+		kids = anchor->children;
+		while((child = HTList_nextObject(kids))) mark_links((HTAnchor*) child);
+	}
+
+	/* Unhook the dead from the table */
+	for(i = 0; i < table_size; i++) {
+		HTParentAnchor** p = &adult_table[i];
+		while((anchor = *p)) {
+			if(anchor->marked) {
+				p = &anchor->next_hash;
+			}
+			else {
+				*p = anchor->next_hash;
+				anchor->next_hash = dead;
+				dead = anchor;
+				table_count--;
+			}
+		}
+	}
+
+	/* Live anchors may have dead sources, but link only to live ones */
+	if(dead) {
+		for(i = 0; i < table_size; i++) {
+			for(anchor = adult_table[i]; anchor; anchor = anchor->next_hash) {
+				if(anchor->sources) prune_sources(anchor);
+			}
+		}
+	}
+	while((anchor = dead)) {
+		dead = anchor->next_hash;
+		free_parent(anchor);
+		freed++;
+	}
+
+	survived_count = table_count;
+	survived_bytes = pool_live;
+	if(TRACE) {
+		fprintf(
+				stderr, "HTAnchor: Collected %ld anchors, %ld left in %ld bytes\n",
+				freed, table_count, pool_live);
+	}
+	return freed;
+}
+
+long HTAnchor_collectIfNeeded(void) {
+	if(HTAnchorMaxCount > 0 && table_count > HTAnchorMaxCount &&
+	   table_count > 2 * survived_count) {
+		return HTAnchor_collect();
+	}
+	if(HTAnchorMaxBytes > 0 && pool_live > HTAnchorMaxBytes &&
+	   pool_live > 2 * survived_bytes) {
+		return HTAnchor_collect();
+	}
+	return 0;
+}
+
+
 /*		Move an anchor to the head of the list of its siblings
 **		------------------------------------------------------
 **
@@ -328,8 +839,19 @@ HyperDoc* HTAnchor_document(HTParentAnchor* me) {
 
 
 void HTAnchor_setAddress(HTAnchor* me, char* addr) {
-	if(me)
-		StrAllocCopy (me->parent->address, addr);
+	if(me) {    /* Rehash it under its new address */
+		HTParentAnchor* parent = me->parent;
+		char buffer[256];
+		char* canonical = canonical_address(addr, buffer, sizeof(buffer));
+
+		if(parent == base_anchor) base_anchor = 0;
+		table_remove(parent);
+		pool_release_string(parent->address);
+		parent->address = pool_string(canonical);
+		HTFingerprintOf(canonical, &parent->fingerprint);
+		table_add(parent);
+		if(canonical != buffer) free(canonical);
+	}
 }
 
 char* HTAnchor_address(HTAnchor* me) {
@@ -364,6 +886,28 @@ HTFormat HTAnchor_format(HTParentAnchor* me) {
 }
 
 
+void HTAnchor_setContentEncoding(HTParentAnchor* me, HTAtom* encoding) {
+	if(me) {
+		me->content_encoding = encoding;
+	}
+}
+
+HTAtom* HTAnchor_contentEncoding(HTParentAnchor* me) {
+	return me ? me->content_encoding : NULL;
+}
+
+
+void HTAnchor_setLength(HTParentAnchor* me, long length) {
+	if(me) {
+		me->length = length;
+	}
+}
+
+long HTAnchor_length(HTParentAnchor* me) {
+	return me ? me->length : 0;
+}
+
+
 void HTAnchor_setIndex(HTParentAnchor* me) {
 	if(me) {
 		me->isIndex = HT_TRUE;
@@ -412,8 +956,7 @@ HTBool HTAnchor_link(
 		source->mainLink.type = type;
 	}
 	else {
-		HTLink* newLink = malloc(sizeof(HTLink));
-		if(newLink == NULL) HTOOM(__FILE__, "HTAnchor_link");
+		HTLink* newLink = pool_alloc(sizeof(HTLink));
 		newLink->dest = destination;
 		newLink->type = type;
 		if(!source->links) {
@@ -462,14 +1005,13 @@ HTBool HTAnchor_makeMainLink(HTAnchor* me, HTLink* movingLink) {
 	}
 	else {
 		/* First push current main link onto top of links list */
-		HTLink* newLink = malloc(sizeof(HTLink));
-		if(newLink == NULL) HTOOM(__FILE__, "HTAnchor_makeMainLink");
+		HTLink* newLink = pool_alloc(sizeof(HTLink));
 		memcpy(newLink, &me->mainLink, sizeof(HTLink));
 		HTList_addObject(me->links, newLink);
 
 		/* Now make movingLink the new main link, and free it */
 		memcpy(&me->mainLink, movingLink, sizeof(HTLink));
-		free(movingLink);
+		pool_release(movingLink, sizeof(HTLink));
 		return HT_TRUE;
 	}
 }
@@ -17,6 +17,7 @@
 
 #include <HTList.h>
 #include <HTAtom.h>
+#include <HTParse.h>
 
 /*                      Main definition of anchor
 **                      =========================
@@ -25,6 +26,7 @@
 typedef struct _HyperDoc HyperDoc;  /* Ready for forward references */
 typedef struct _HTAnchor HTAnchor;
 typedef struct _HTParentAnchor HTParentAnchor;
+typedef struct _HTChildAnchor HTChildAnchor;
 
 /*      After definition of HTFormat: */
 #include <HTFormat.h>
@@ -54,17 +56,27 @@ struct _HTParentAnchor {
 	HTList* children;       /* Subanchors of this, if any */
 	HTList* sources;        /* List of anchors pointing to this, if any */
 	HyperDoc* document;       /* The document within which this is an anchor */
-	char* address;        /* Absolute address of this node */
+	char* address;        /* Absolute address of this node, canonical */
 	HTFormat format;         /* Pointer to node format descriptor */
+	HTAtom* content_encoding; /* Encoding still to be undone, if any */
+	long length;         /* Of the body being loaded, 0 if not known */
 	HTBool isIndex;        /* Acceptance of a keyword search */
 	char* title;          /* Title of document */
 
 	HTList* methods;        /* Methods available as HTAtoms */
 	void* protocol;       /* Protocol object */
 	char* physical;       /* Physical address */
+
+	HTFingerprint fingerprint;    /* Of address */
+	HTParentAnchor* next_hash;      /* Next in the same hash bucket */
+	HTChildAnchor** child_index;    /* Named children by hash, if many */
+	int child_slots;    /* Size of child_index */
+	int child_count;    /* Children in child_index */
+	int keep;           /* Times HTAnchor_keep'd: not to be collected */
+	HTBool marked;         /* Reachable, during HTAnchor_collect */
 };
 
-typedef struct {
+struct _HTChildAnchor {
 	/* Common part from the generic anchor structure */
 	HTLink mainLink;       /* Main (or default) destination of this */
 	HTList* links;          /* List of extra links from this, if any */
@@ -72,7 +84,8 @@ typedef struct {
 
 	/* ChildAnchor-specific information */
 	char* tag;            /* Address of this anchor relative to parent */
-} HTChildAnchor;
+	unsigned long hash;           /* Of tag, ignoring case */
+};
 
 
 /*      Create new or find old sub-anchor
@@ -105,12 +118,39 @@ HTChildAnchor* HTAnchor_findChildAndLink(
 **      This one is for a reference which is found in a document, and might
 **      not be already loaded.
 **      Note: You are not guaranteed a new anchor -- you might get an old one,
-**      like with fonts.
+**      like with fonts. Addresses which HTCanonicalInto makes the same find
+**      the same anchor, which has the canonical address.
 */
 
 HTAnchor* HTAnchor_findAddress(const char* address);
 
 
+/*      How full the anchor tables are
+**      ------------------------------
+**
+**      Parent anchors are kept in a hash table which doubles when it holds
+**      more anchors than buckets. A parent with many named children gets a
+**      hash index of them too. HTAnchor_stats fills in how full these are,
+**      for tuning and tracing; it looks at every parent, so is not cheap.
+**
+**      Anchors, links, addresses and tags come from a pool of big blocks
+**      which is never given back to the system; pieces freed are reused.
+*/
+typedef struct {
+	long parents;        /* Parent anchors in the table */
+	long buckets;        /* Size of the table */
+	long used_buckets;   /* Buckets with at least one anchor */
+	long longest_chain;  /* Most anchors in one bucket */
+	long indexed_parents; /* Parents with a child index */
+	long indexed_children; /* Children in those indexes */
+	long child_slots;    /* Total size of those indexes */
+	long pool_bytes;     /* Allocated for anchors, links, addresses and tags */
+	long live_bytes;     /* Of that, in use */
+} HTAnchorStats;
+
+void HTAnchor_stats(HTAnchorStats* stats);
+
+
 /*      Delete an anchor and possibly related things (auto garbage collection)
 **      --------------------------------------------
 **
@@ -124,6 +164,36 @@ HTAnchor* HTAnchor_findAddress(const char* address);
 HTBool HTAnchor_delete(HTParentAnchor* me);
 
 
+/*      Collect anchors nothing can reach
+**      ---------------------------------
+**
+**      A parent anchor is live if it has a document, if it has been kept
+**      with HTAnchor_keep more times than HTAnchor_unkeep, or if a live
+**      anchor or one of its children links to it. HTAnchor_collect frees
+**      every anchor which is not live, with its children and links, and
+**      returns how many parents went. Pointers to them held elsewhere
+**      become invalid, so keep any anchor you hold without a document.
+**
+**      HTAnchor_collectIfNeeded collects only if there are more than
+**      HTAnchorMaxCount parent anchors or more than HTAnchorMaxBytes
+**      live_bytes (see HTAnchor_stats), and more than twice what was left
+**      after the last collection. Both limits are 0, meaning none, unless
+**      the application sets them. HTLoadDocument calls it before loading.
+**      HTHistory keeps the anchors in the history.
+*/
+
+void HTAnchor_keep(HTAnchor* me);
+
+void HTAnchor_unkeep(HTAnchor* me);
+
+long HTAnchor_collect(void);
+
+long HTAnchor_collectIfNeeded(void);
+
+extern long HTAnchorMaxCount;
+extern long HTAnchorMaxBytes;
+
+
 /*              Move an anchor to the head of the list of its siblings
 **              ------------------------------------------------------
 **
@@ -156,6 +226,22 @@ void HTAnchor_setFormat(HTParentAnchor* me, HTFormat form);
 
 HTFormat HTAnchor_format(HTParentAnchor* me);
 
+/*      Content-Encoding of the body being loaded, set by the MIME parser.
+**      HTStreamStack resets it to NULL once it has put a decoder in place.
+*/
+void HTAnchor_setContentEncoding(HTParentAnchor* me, HTAtom* encoding);
+
+HTAtom* HTAnchor_contentEncoding(HTParentAnchor* me);
+
+/*      Length of the body being loaded, as sent: set by the MIME parser from
+**      Content-Length and by HTFile from the size of the file, and reset to
+**      0 (not known) by HTLoadDocument. HTStreamStack chooses its chain for
+**      this length, as HTStackValue does for the length it is given.
+*/
+void HTAnchor_setLength(HTParentAnchor* me, long length);
+
+long HTAnchor_length(HTParentAnchor* me);
+
 void HTAnchor_setIndex(HTParentAnchor* me);
 
 HTBool HTAnchor_isIndex(HTParentAnchor* me);
@@ -6,64 +6,229 @@
  *	so that they can be stored more efficiently, and comparisons
  *	for equality done more efficiently.
  *
- *	Atoms are kept in a hash table consisting of an array of linked lists.
+ *	Atoms are kept in an open addressed hash table of pointers which
+ *	doubles when it is half full, hashed with 32 bit FNV-1a. Each
+ *	atom and its name are carved together out of an arena, so making
+ *	an atom costs no malloc of its own; atoms are never freed.
+ *
+ *	Several threads may make atoms at once without a lock:
+ *
+ *	-	Lookups only read. A slot goes from empty to an atom, or from
+ *		empty to FROZEN, with compare-and-swap, and never changes
+ *		again, so a probe which meets an empty slot knows the name
+ *		is not there.
+ *	-	To grow a table, one thread hangs a bigger one off it, freezes
+ *		every empty slot, copies the atoms across and then makes the
+ *		bigger table current. A probe which meets FROZEN carries on
+ *		in the bigger table. Old tables are kept for threads which
+ *		may still be reading them; together they are smaller than the
+ *		current one.
+ *	-	The arena is claimed by atomic addition.
+ *
+ *	This needs the GCC/Clang __atomic builtins. Other compilers get
+ *	plain loads and stores, which are only safe with a single thread.
  *
  * Authors:
  *	TBL	Tim Berners-Lee, WorldWideWeb project, CERN
  *	(c) Copyright CERN 1991 - See Copyright.html
  */
 
-#define HASH_SIZE (101) /* Tunable */
+#define MIN_TABLE_SIZE 256    /* Must be a power of 2 */
+#define ARENA_BLOCK 8192    /* Tunable */
 
 #include <HTAtom.h>
 #include <HTUtils.h>
 #include <HTSTD.h>
 
-static HTAtom* hash_table[HASH_SIZE];
-static HTBool initialised = HT_FALSE;
+#ifdef __GNUC__
+#define LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ADD(p, n) __atomic_fetch_add((p), (n), __ATOMIC_ACQ_REL)
+#define CAS(p, old, new) \
+	cas_pointer((void**) (p), (void*) (old), (void*) (new))
 
-HTAtom* HTAtom_for(const char* string) {
-	int hash;
-	const char* p;
-	HTAtom* a;
-
-	/*		First time around, clear hash table
-	*/
-	if(!initialised) {
-		int i;
-		for(i = 0; i < HASH_SIZE; i++) {
-			hash_table[i] = (HTAtom*) 0;
-		}
-		initialised = HT_TRUE;
+static HTBool cas_pointer(void** p, void* old, void* new) {
+	return __atomic_compare_exchange_n(
+			p, &old, new, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ?
+		   HT_TRUE : HT_FALSE;
+}
+#else
+#define LOAD(p) (*(p))
+#define ADD(p, n) ((*(p) += (n)) - (n))
+#define CAS(p, old, new) \
+	(*(p) == (old) ? (*(p) = (new), HT_TRUE) : HT_FALSE)
+#endif
+
+typedef struct _HTAtomTable HTAtomTable;
+struct _HTAtomTable {
+	unsigned long size;        /* Power of 2 */
+	unsigned long count;        /* Atoms put in this table */
+	HTAtomTable* next;        /* Bigger table, once growing has begun */
+	HTAtom** slots;
+};
+
+typedef struct _HTAtomArena {
+	size_t size;
+	size_t used;        /* May run past size when claims collide */
+	char* data;
+} HTAtomArena;
+
+static HTAtom frozen;        /* Marks an empty slot closed by growing */
+#define FROZEN (&frozen)
+
+static HTAtomTable* current = 0;
+static HTAtomArena* arena = 0;
+
+
+/*	FNV-1a hash
+*/
+static unsigned long hash_of(const char* string, size_t length) {
+	unsigned long hash = 2166136261UL;
+	size_t i;
+
+	for(i = 0; i < length; i++) {
+		hash ^= (unsigned char) string[i];
+		hash = (hash * 16777619UL) & 0xffffffffUL;
 	}
+	return hash;
+}
+
+
+/*	Room for an atom and its name
+**
+**	Atoms are aligned as for a pointer; names follow them. A thread
+**	which finds the block used up puts in a new one; if another got
+**	there first it throws its own away and tries again.
+*/
+static HTAtom* arena_atom(size_t length) {
+	size_t size = sizeof(HTAtom) + length + 1;
+
+	size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+	for(;;) {
+		HTAtomArena* a = LOAD(&arena);
+		HTAtomArena* fresh;
+		size_t block;
+
+		if(a) {
+			size_t used = ADD(&a->used, size);
+			if(used + size <= a->size) return (HTAtom*) (a->data + used);
+		}
 
-	/*		Generate hash function
-	*/
-	for(p = string, hash = 0; *p; p++) {
-		hash = (hash * 3 + *p) % HASH_SIZE;
+		block = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+		fresh = malloc(sizeof(*fresh) + block);
+		if(!fresh) HTOOM(__FILE__, "HTAtom_for");
+		fresh->size = block;
+		fresh->used = 0;
+		fresh->data = (char*) (fresh + 1);
+		if(!CAS(&arena, a, fresh)) free(fresh);
 	}
+}
+
+
+static HTAtomTable* new_table(unsigned long size) {
+	HTAtomTable* t = malloc(sizeof(*t));
+
+	if(!t) HTOOM(__FILE__, "HTAtom_for");
+	t->slots = calloc(size, sizeof(HTAtom*));
+	if(!t->slots) HTOOM(__FILE__, "HTAtom_for");
+	t->size = size;
+	t->count = 0;
+	t->next = 0;
+	return t;
+}
 
-	/*		Search for the string in the list
-	*/
-	for(a = hash_table[hash]; a; a = a->next) {
-		if(0 == strcmp(a->name, string)) {
+
+static void grow_table(HTAtomTable* t);
+
+
+/*	Put an atom in a table, or find the one already there
+**
+**	If string is 0 the atom given is being moved to a bigger table and
+**	is known not to be there yet. Otherwise atom may be 0, and is made
+**	from string if it has to be put in.
+*/
+static HTAtom* find_or_add(
+		HTAtomTable* t, const char* string, size_t length,
+		unsigned long hash, HTAtom* atom) {
+	unsigned long slot;
+
+	for(slot = hash & (t->size - 1);; slot = (slot + 1) & (t->size - 1)) {
+		HTAtom* a = LOAD(&t->slots[slot]);
+
+		if(!a) {
+			if(!atom) {
+				atom = arena_atom(length);
+				atom->name = (char*) (atom + 1);
+				memcpy(atom->name, string, length);
+				atom->name[length] = 0;
+				atom->length = length;
+				atom->hash = hash;
+			}
+			if(CAS(&t->slots[slot], NULL, atom)) {
+				if(2 * (ADD(&t->count, 1) + 1) > t->size) grow_table(t);
+				return atom;
+			}
+			a = LOAD(&t->slots[slot]);    /* Somebody else got the slot */
+		}
+
+		if(a == FROZEN) {    /* Carry on in the bigger table */
+			t = LOAD(&t->next);
+			slot = (hash - 1) & (t->size - 1);    /* Loop adds 1 */
+			continue;
+		}
+
+		if(string && a->hash == hash && a->length == length &&
+		   0 == memcmp(a->name, string, length)) {
 			/* if (TRACE) fprintf(stderr,
 			"HTAtom: Old atom %p for `%s'\n", a, string); */
 			return a;                /* Found: return it */
 		}
 	}
+}
+
+
+/*	Grow a table
+**
+**	Only the thread which hangs the bigger table on does the work. The
+**	others go on using the old table until they meet a frozen slot.
+*/
+static void grow_table(HTAtomTable* t) {
+	HTAtomTable* bigger;
+	unsigned long i;
+
+	if(LOAD(&t->next)) return;    /* Already being done */
+	bigger = new_table(t->size * 2);
+	if(!CAS(&t->next, NULL, bigger)) {
+		free(bigger->slots);
+		free(bigger);
+		return;
+	}
+
+	for(i = 0; i < t->size; i++) CAS(&t->slots[i], NULL, FROZEN);
+	for(i = 0; i < t->size; i++) {
+		HTAtom* a = LOAD(&t->slots[i]);
+		if(a != FROZEN) find_or_add(bigger, 0, a->length, a->hash, a);
+	}
+
+	/* Move current on, unless a later table has already replaced it */
+	CAS(&current, t, bigger);
+}
 
-	/*		Generate a new entry
-	*/
-	a = malloc(sizeof(*a));
-	if(!a) HTOOM(__FILE__, "HTAtom_for");
-	a->name = malloc(strlen(string) + 1);
-	if(!a->name) HTOOM(__FILE__, "HTAtom_for");
-	strcpy(a->name, string);
-	a->next = hash_table[hash];        /* Put onto the head of list */
-	hash_table[hash] = a;
-/*    if (TRACE) fprintf(stderr, "HTAtom: New atom %p for `%s'\n", a, string); */
-	return a;
+
+HTAtom* HTAtom_forLen(const char* string, size_t length) {
+	HTAtomTable* t = LOAD(&current);
+
+	if(!t) {
+		HTAtomTable* first = new_table(MIN_TABLE_SIZE);
+		if(!CAS(&current, NULL, first)) {
+			free(first->slots);
+			free(first);
+		}
+		t = LOAD(&current);
+	}
+	return find_or_add(t, string, length, hash_of(string, length), 0);
 }
 
 
+HTAtom* HTAtom_for(const char* string) {
+	return HTAtom_forLen(string, strlen(string));
+}
@@ -11,6 +11,10 @@
 **      will always (within one run of the program) return the same
 **      value for the same given string.
 **
+**      HTAtom_forLen(string, length) does the same for the first length
+**      characters of string, which need not be terminated, so that part
+**      of a buffer can be looked up without copying it.
+**
 ** Authors:
 **      TBL     Tim Berners-Lee, WorldWideWeb project, CERN
 **
@@ -21,15 +25,20 @@
 #ifndef HTATOM_H
 #define HTATOM_H
 
+#include <stddef.h>
+
 typedef struct _HTAtom HTAtom;
 struct _HTAtom {
-	HTAtom* next;
 	char* name;
+	size_t length;        /* Of name */
+	unsigned long hash;
 }; /* struct _HTAtom */
 
 
 HTAtom* HTAtom_for(const char* string);
 
+HTAtom* HTAtom_forLen(const char* string, size_t length);
+
 #define HTAtom_name(a) ((a)->name)
 
 #endif  /* HTATOM_H */
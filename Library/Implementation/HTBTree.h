@@ -1,7 +1,14 @@
 /*                  /Net/dxcern/userd/timbl/hypertext/WWW/Library/Implementation/HTBTree.html
-                         BALANCED BINARY TREE FOR SORTING THINGS
+                               SORTED ARRAY FOR SORTING THINGS
                                              
-   Tree creation, traversal and freeing. User-supplied comparison routine.
+   Collection, sorting, traversal and freeing. User-supplied comparison routine.
+   
+   Objects are appended to one growing array and sorted all at once, the first time the
+   array is traversed, by a stable merge sort: objects which compare equal come out in
+   the order they were added. Adding more objects after that sorts the array again on the
+   next traversal, so don't add while traversing.
+   
+   The names are those of the balanced binary tree this replaces.
    
    Author: Arthur Secret, CERN. Public domain. Please mail bugs and changes to
    www-request@info.cern.ch
@@ -9,33 +16,32 @@
    part of libWWW
    
  */
+#ifndef HTBTREE_H
+#define HTBTREE_H
 
+#include <HTUtils.h>
 
 /*
 
 Data structures
 
  */
-typedef struct _HTBTree_element {
-	void* object;        /* User object */
-	struct _HTBTree_element* up;
-	struct _HTBTree_element* left;
-	int left_depth;
-	struct _HTBTree_element* right;
-	int right_depth;
-} HTBTElement;
+typedef void* HTBTElement;        /* A slot in the array */
 
 typedef int (* HTComparer)(void* a, void* b);
 
 typedef struct _HTBTree_top {
 	HTComparer compare;
-	struct _HTBTree_element* top;
+	void** objects;
+	int count;
+	int allocated;
+	HTBool sorted;
 } HTBTree;
 
 
 /*
 
-Create a binary tree given its discrimination routine
+Create a sorted array given its discrimination routine
 
  */
 HTBTree* HTBTree_new(HTComparer comp);
@@ -43,7 +49,7 @@ HTBTree* HTBTree_new(HTComparer comp);
 
 /*
 
-Free storage of the tree but not of the objects
+Free storage of the array but not of the objects
 
  */
 void HTBTree_free(HTBTree* tree);
@@ -51,7 +57,7 @@ void HTBTree_free(HTBTree* tree);
 
 /*
 
-Free storage of the tree and of the objects
+Free storage of the array and of the objects
 
  */
 void HTBTreeAndObject_free(HTBTree* tree);
@@ -59,28 +65,41 @@ void HTBTreeAndObject_free(HTBTree* tree);
 
 /*
 
-Add an object to a binary tree
+Add an object
 
  */
 
 void HTBTree_add(HTBTree* tree, void* object);
 
 
+/*
+
+Sort the objects now
+
+   HTBTree_next does this if it is needed, so this is only useful to choose when the time
+   is spent.
+   
+ */
+void HTBTree_sort(HTBTree* tree);
+
+
 /*
 
 Find user object for element
 
  */
-#define HTBTree_object(element)  ((element)->object)
+#define HTBTree_object(element)  (*(element))
+
+#define HTBTree_count(tree)  ((tree)->count)
 
 
 /*
 
-Find next element in depth-first order
+Find next element in sorted order
 
   ON ENTRY,
   
-  ele                    if NULL, start with leftmost element. if != 0 give next object to
+  ele                    if NULL, start with the first element. if != 0 give next object to
                          the right.
                          
   returns                Pointer to element ot NULL if none left.
@@ -88,6 +107,21 @@ Find next element in depth-first order
  */
 HTBTElement* HTBTree_next(HTBTree* tree, HTBTElement* ele);
 
+
+/*
+
+Comparison routines
+
+   Both compare strings without regard to case. HTBTree_naturalCompare also compares runs
+   of digits by their numeric value, so that "file9" comes before "file10".
+   
+ */
+int HTBTree_caseCompare(void* a, void* b);
+
+int HTBTree_naturalCompare(void* a, void* b);
+
+#endif /* HTBTREE_H */
+
 /*
 
    end  */
@@ -696,7 +696,7 @@ static int read_directory(
 
 
 	{
-		HTBTree* bt = HTBTree_new((HTComparer) strcasecomp);
+		HTBTree* bt = HTBTree_new(HTBTree_caseCompare);
 		char c;
 		HTChunk* chunk = HTChunkCreate(128);
 		START(HTML_DIR);
@@ -116,7 +116,7 @@ static const HTStreamClass HTFWriter = /* As opposed to print etc */
 		{
 				"FileWriter", HTFWriter_free, HTFWriter_abort,
 				HTFWriter_put_character, HTFWriter_put_string,
-				HTFWriter_write };
+				HTFWriter_write, NULL };
 
 
 /*	Subclass-specific Methods
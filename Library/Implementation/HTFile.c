@@ -38,8 +38,8 @@
 #include <HTAtom.h>
 #include <HTWriter.h>
 #include <HTFWriter.h>
+#include <HTInflate.h>
 #include <HTInit.h>
-#include <HTBTree.h>
 
 typedef struct _HTSuffix {
 	char* suffix;
@@ -49,11 +49,26 @@ typedef struct _HTSuffix {
 } HTSuffix;
 
 
+/*	Directories are read for .multi negotiation wherever that can be
+**	done. Directory listings are only sent with GOT_READ_DIR, as any
+**	readable directory can then be browsed unless HTDirAccess says not.
+*/
+#if defined(GOT_READ_DIR) || defined(USE_DIRENT)
+#define CAN_READ_DIR
+#endif
+
+#ifdef CAN_READ_DIR
 #ifdef USE_DIRENT        /* Set this for Sys V systems */
+#include <dirent.h>
 #define STRUCT_DIRENT struct dirent
 #else
+#include <sys/dir.h>
 #define STRUCT_DIRENT struct direct
 #endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#endif
 
 #include <HTML.h>        /* For directory object building */
 
@@ -74,6 +89,7 @@ struct _HTStructured {
 
 int HTDirAccess = HT_DIR_OK;
 int HTDirReadme = HT_DIR_README_TOP;
+long HTDirCacheSize = 1048576L;    /* Bytes of directory listings kept */
 
 static char* HTMountRoot = "/Net/";        /* Where to find mounts */
 #ifdef vms
@@ -89,9 +105,84 @@ static char* HTCacheRoot = "/tmp/W3_Cache_";   /* Where to cache things */
 */
 
 static HTList* HTSuffixes = 0;
+static long suffix_version = 0;    /* Changed by each HTSetSuffix */
 static HTSuffix no_suffix = { "*", NULL, NULL, 1.0 };
 static HTSuffix unknown_suffix = { "*.*", NULL, NULL, 1.0 };
 
+/*	Suffixes are looked up in a trie of their characters read backwards
+**	from the end, so a file name is matched by walking back from its
+**	last character. Each node's children are a short sibling list.
+**	The longest registered suffix of the name wins.
+*/
+typedef struct _HTSuffixNode {
+	char c;
+	HTSuffix* suffix;        /* Ending here, or 0 */
+	struct _HTSuffixNode* child;
+	struct _HTSuffixNode* sibling;
+} HTSuffixNode;
+
+static HTSuffixNode suffix_root = { 0, NULL, NULL, NULL };
+
+/*	The suffix to use for each representation: the last one registered.
+**	Atoms are unique, so the atom pointer is the key.
+*/
+#define REP_HASH_SIZE 64
+
+typedef struct _HTRepSuffix {
+	HTAtom* rep;
+	HTSuffix* suffix;
+	struct _HTRepSuffix* next;
+} HTRepSuffix;
+
+static HTRepSuffix* rep_suffixes[REP_HASH_SIZE];
+
+#define REP_HASH(rep) ((unsigned) (((size_t) (rep) >> 3) % REP_HASH_SIZE))
+
+
+/*	Add a suffix to the trie, replacing any earlier one the same
+*/
+static void trie_add(HTSuffix* suff) {
+	HTSuffixNode* node = &suffix_root;
+	const char* p;
+
+	for(p = suff->suffix + strlen(suff->suffix); p > suff->suffix;) {
+		HTSuffixNode* child;
+		char c = *--p;
+
+		for(child = node->child; child; child = child->sibling) {
+			if(child->c == c) break;
+		}
+		if(!child) {
+			child = calloc(1, sizeof(HTSuffixNode));
+			if(child == NULL) HTOOM(__FILE__, "HTSetSuffix");
+			child->c = c;
+			child->sibling = node->child;
+			node->child = child;
+		}
+		node = child;
+	}
+	node->suffix = suff;
+}
+
+
+/*	Find the longest suffix of the first length characters of a name
+*/
+static HTSuffix* trie_find(const char* filename, size_t length) {
+	HTSuffixNode* node = &suffix_root;
+	HTSuffix* found = suffix_root.suffix;    /* Only set by "" */
+	const char* p;
+
+	for(p = filename + length; p > filename && node;) {
+		char c = *--p;
+
+		for(node = node->child; node; node = node->sibling) {
+			if(node->c == c) break;
+		}
+		if(node && node->suffix) found = node->suffix;
+	}
+	return found;
+}
+
 
 /*	Define the representation associated with a file suffix
 **	-------------------------------------------------------
@@ -126,10 +217,30 @@ void HTSetSuffix(
 		char* p;
 		StrAllocCopy(enc, encoding);
 		for(p = enc; *p; p++) *p = (char) tolower(*p);
-		suff->encoding = HTAtom_for(encoding);
+		suff->encoding = HTAtom_for(enc);
+		free(enc);
 	}
 
-	suff->quality = (char) value;
+	suff->quality = (float) value;
+	suffix_version++;
+
+	if(suff == &no_suffix || suff == &unknown_suffix) return;
+
+	trie_add(suff);
+	{
+		HTRepSuffix** bucket = &rep_suffixes[REP_HASH(suff->rep)];
+		HTRepSuffix* r;
+
+		for(r = *bucket; r; r = r->next) if(r->rep == suff->rep) break;
+		if(!r) {
+			r = malloc(sizeof(*r));
+			if(r == NULL) HTOOM(__FILE__, "HTSetSuffix");
+			r->rep = suff->rep;
+			r->next = *bucket;
+			*bucket = r;
+		}
+		r->suffix = suff;
+	}
 }
 
 
@@ -220,9 +331,6 @@ static void do_readme (HTStructured * target, const char* localname)
 	fp = fopen(readme_file_name,  "r");
 
 	if (fp) {
-	HTStructuredClass targetClass;
-
-	targetClass =  *target->isa;	/* (Can't init agregate in K&R) */
 	START(HTML_PRE);
 	for(;;){
 		char c = fgetc(fp);
@@ -251,6 +359,366 @@ Bug removed thanks to joe@athena.mit.edu */
 #endif
 
 
+/*	Directory listings
+**	------------------
+**
+**	The names are read into one arena and the entries sorted once as an
+**	array, directories first. Whether an entry is a directory comes from
+**	d_type where the system fills it in, or else from fstatat() relative
+**	to the open directory, so no path is built for each entry.
+*/
+#ifdef CAN_READ_DIR
+typedef struct _HTDirItem {
+	size_t name;        /* Offset of the name in the arena */
+	char kind;        /* 'D' for a directory, 'F' for anything else */
+} HTDirItem;
+
+typedef struct _HTVariant {
+	size_t name;        /* Offset of the name in the arena */
+	HTFormat rep;
+	HTAtom* encoding;
+	float quality;
+} HTVariant;
+
+typedef struct _HTDirListing {
+	struct _HTDirListing* next;    /* In the cache, most recent first */
+	char* path;
+	time_t mtime;        /* Of the directory when it was read */
+	time_t ctime;        /* Likewise: changes with its permissions */
+	int watch;        /* inotify watch descriptor, or -1 */
+	HTBool stale;        /* Changed since it was read */
+	HTBool cached;
+	char* arena;
+	size_t used;
+	size_t size;
+	HTDirItem* items;
+	int count;
+	int allocated;
+	HTVariant* variants;        /* Files sorted by name for .multi, or 0 */
+	int variant_count;
+	long suffix_version;        /* Suffixes the variants were typed with */
+	long cost;        /* Bytes counted against HTDirCacheSize */
+} HTDirListing;
+
+static const char* sort_arena;    /* For compare_items: qsort has no context */
+
+static int compare_items(const void* a, const void* b) {
+	const HTDirItem* x = (const HTDirItem*) a;
+	const HTDirItem* y = (const HTDirItem*) b;
+
+	if(x->kind != y->kind) return x->kind == 'D' ? -1 : 1;
+	return strcasecomp(sort_arena + x->name, sort_arena + y->name);
+}
+
+static char entry_kind(
+		DIR* dp, const char* localname, STRUCT_DIRENT* dirbuf) {
+	struct stat file_info;
+
+#ifdef DT_DIR
+	if(dirbuf->d_type == DT_DIR) return 'D';
+	if(dirbuf->d_type != DT_UNKNOWN && dirbuf->d_type != DT_LNK) return 'F';
+#endif
+#ifdef AT_FDCWD
+	(void) localname;
+
+	if(fstatat(dirfd(dp), dirbuf->d_name, &file_info, 0) < 0) return 'F';
+#else
+	{
+		char* path = NULL;
+		int status;
+
+		(void) dp;
+
+		StrAllocCopy(path, localname);
+		if(strcmp(localname, "/")) StrAllocCat(path, "/");
+		StrAllocCat(path, dirbuf->d_name);
+		status = stat(path, &file_info);
+		free(path);
+		if(status < 0) return 'F';
+	}
+#endif
+	return ((file_info.st_mode) & S_IFMT) == S_IFDIR ? 'D' : 'F';
+}
+
+static void read_listing(DIR* dp, const char* localname, HTDirListing* list) {
+	STRUCT_DIRENT* dirbuf;
+
+	list->size = 4096;
+	list->used = 0;
+	list->arena = malloc(list->size);
+	list->allocated = 64;
+	list->count = 0;
+	list->items = malloc(list->allocated * sizeof(HTDirItem));
+	if(!list->arena || !list->items) HTOOM(__FILE__, "read_listing");
+
+	while((dirbuf = readdir(dp)) != 0) {
+		size_t length;
+
+		if(dirbuf->d_ino == 0) continue;    /* Entry not in use */
+		if(*dirbuf->d_name == '.' || *dirbuf->d_name == ',') {
+			continue;    /* Hidden */
+		}
+
+		length = strlen(dirbuf->d_name) + 1;
+		if(list->used + length > list->size) {
+			while(list->used + length > list->size) list->size *= 2;
+			list->arena = realloc(list->arena, list->size);
+			if(!list->arena) HTOOM(__FILE__, "read_listing");
+		}
+		if(list->count == list->allocated) {
+			list->allocated *= 2;
+			list->items = realloc(
+					list->items, list->allocated * sizeof(HTDirItem));
+			if(!list->items) HTOOM(__FILE__, "read_listing");
+		}
+
+		memcpy(list->arena + list->used, dirbuf->d_name, length);
+		list->items[list->count].name = list->used;
+		list->items[list->count].kind = entry_kind(dp, localname, dirbuf);
+		list->count++;
+		list->used += length;
+	}
+
+	sort_arena = list->arena;
+	qsort(list->items, list->count, sizeof(HTDirItem), compare_items);
+}
+
+
+/*	Cache of directory listings
+**	---------------------------
+**
+**	Listings are kept by path, most recently used first, until they
+**	add up to more than HTDirCacheSize bytes. One is thrown away when
+**	the directory's modification or status change time changes or, on
+**	Linux, when an inotify watch reports that an entry was added,
+**	removed or renamed or that its permissions or those of the
+**	directory changed, which also catches changes within the same
+**	second.
+*/
+static HTDirListing* listings = 0;
+static long listing_bytes = 0;
+
+#ifdef __linux__
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+		IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static int inotify_fd = -2;    /* Not tried yet */
+
+static int add_watch(const char* localname) {
+	if(inotify_fd == -2) inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(inotify_fd < 0) return -1;
+	return inotify_add_watch(inotify_fd, localname, WATCH_EVENTS);
+}
+
+/*	Mark the listings which have changed since last time */
+static void read_watches(void) {
+	char buffer[4096];
+	int status;
+
+	if(inotify_fd < 0) return;
+	while((status = (int) read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+		char* p = buffer;
+
+		while(p < buffer + status) {
+			struct inotify_event* event = (struct inotify_event*) p;
+			HTDirListing* l;
+
+			for(l = listings; l; l = l->next) {
+				if(l->watch == event->wd || (event->mask & IN_Q_OVERFLOW)) {
+					l->stale = HT_TRUE;
+				}
+			}
+			p += sizeof(struct inotify_event) + event->len;
+		}
+	}
+}
+#else
+#define add_watch(localname) (-1)
+#define read_watches()
+#endif
+
+static long listing_cost(HTDirListing* l) {
+	return (long) (sizeof(*l) + strlen(l->path) + 1 + l->size +
+				   l->allocated * sizeof(HTDirItem) +
+				   l->variant_count * sizeof(HTVariant));
+}
+
+static void free_listing(HTDirListing* l) {
+#ifdef __linux__
+	if(l->watch >= 0) {
+		HTDirListing* other;
+
+		/* Two paths to the same directory share a watch */
+		for(other = listings; other; other = other->next) {
+			if(other != l && other->watch == l->watch) break;
+		}
+		if(!other) inotify_rm_watch(inotify_fd, l->watch);
+	}
+#endif
+	free(l->path);
+	free(l->arena);
+	free(l->items);
+	free(l->variants);
+	free(l);
+}
+
+/*	Take a listing out of the cache */
+static void drop_listing(HTDirListing* l) {
+	HTDirListing** p;
+
+	for(p = &listings; *p; p = &(*p)->next) {
+		if(*p == l) {
+			*p = l->next;
+			listing_bytes -= l->cost;
+			l->cached = HT_FALSE;
+			return;
+		}
+	}
+}
+
+/*	Add a listing, then throw out the least recent until under the limit */
+static void keep_listing(HTDirListing* l) {
+	l->cost = listing_cost(l);
+	if(l->cost > HTDirCacheSize) return;
+
+	l->next = listings;
+	listings = l;
+	l->cached = HT_TRUE;
+	listing_bytes += l->cost;
+
+	while(listing_bytes > HTDirCacheSize) {
+		HTDirListing* last = listings;
+
+		while(last->next) last = last->next;
+		drop_listing(last);
+		free_listing(last);
+	}
+}
+
+/*	Get the listing of a directory
+**
+**	Returns 0 if the directory can't be read. A listing which didn't go
+**	into the cache must be given back with release_listing.
+*/
+static HTDirListing* get_listing(
+		const char* localname, const struct stat* dir_info) {
+	HTDirListing* l;
+	DIR* dp;
+
+	read_watches();
+	for(l = listings; l; l = l->next) {
+		if(!strcmp(l->path, localname)) break;
+	}
+	if(l) {
+		drop_listing(l);
+		if(!l->stale && l->mtime == dir_info->st_mtime &&
+		   l->ctime == dir_info->st_ctime) {
+			if(TRACE) fprintf(stderr, "HTFile: Listing of %s cached\n", localname);
+			keep_listing(l);    /* Now the most recent */
+			return l;
+		}
+		free_listing(l);
+	}
+
+	dp = opendir(localname);
+	if(!dp) return 0;
+
+	l = malloc(sizeof(*l));
+	if(l == NULL) HTOOM(__FILE__, "get_listing");
+	l->next = 0;
+	l->path = NULL;
+	StrAllocCopy(l->path, localname);
+	l->mtime = dir_info->st_mtime;
+	l->ctime = dir_info->st_ctime;
+	l->stale = HT_FALSE;
+	l->cached = HT_FALSE;
+	l->variants = 0;
+	l->variant_count = 0;
+	l->cost = 0;
+	l->watch = HTDirCacheSize > 0 ? add_watch(localname) : -1;
+
+	read_listing(dp, localname, l);
+	closedir(dp);
+
+	keep_listing(l);
+	return l;
+}
+
+static void release_listing(HTDirListing* l) {
+	if(!l->cached) free_listing(l);
+}
+
+
+/*	Variants for content negotiation
+**	--------------------------------
+**
+**	A request for "dir/base.multi" may be answered by any file in dir
+**	whose name is longer than and starts with base. The files of a
+**	listing are typed once, through HTFileFormat and HTFileValue, and
+**	kept sorted by name, so the variants of a base are found by a binary
+**	search. They go with the cached listing, so they are built again
+**	when the directory changes, and also when a suffix is redefined.
+**	Names starting with '.' or ',' are hidden from the listing, so are
+**	never variants, though the old directory scan let them be.
+*/
+static int compare_variants(const void* a, const void* b) {
+	return strcmp(
+			sort_arena + ((const HTVariant*) a)->name,
+			sort_arena + ((const HTVariant*) b)->name);
+}
+
+static void type_variants(HTDirListing* l) {
+	int i;
+
+	free(l->variants);
+	l->variants = malloc((l->count ? l->count : 1) * sizeof(HTVariant));
+	if(l->variants == NULL) HTOOM(__FILE__, "type_variants");
+
+	l->variant_count = 0;
+	for(i = 0; i < l->count; i++) {
+		HTVariant* v = &l->variants[l->variant_count];
+		const char* name = l->arena + l->items[i].name;
+
+		if(l->items[i].kind != 'F') continue;
+		v->name = l->items[i].name;
+		v->rep = HTFileFormat(name, &v->encoding);
+		v->quality = HTFileValue(name);
+		l->variant_count++;
+	}
+	sort_arena = l->arena;
+	qsort(l->variants, l->variant_count, sizeof(HTVariant), compare_variants);
+	l->suffix_version = suffix_version;
+
+	if(l->cached) {    /* Count the variants against the cache too */
+		long cost = listing_cost(l);
+		listing_bytes += cost - l->cost;
+		l->cost = cost;
+	}
+}
+
+/*	Find the first variant of a base name, or the end of the variants
+*/
+static HTVariant* first_variant(
+		HTDirListing* l, const char* base, size_t baselen) {
+	int low = 0;
+	int high;
+
+	if(!l->variants || l->suffix_version != suffix_version) type_variants(l);
+
+	high = l->variant_count;
+	while(low < high) {
+		int middle = (low + high) / 2;
+
+		if(strncmp(l->arena + l->variants[middle].name, base, baselen) < 0) {
+			low = middle + 1;
+		}
+		else high = middle;
+	}
+	return &l->variants[low];
+}
+#endif
+
+
 /*	Make the cache file name for a W3 document
 **	------------------------------------------
 **	Make up a suitable name for saving the node in
@@ -391,19 +859,13 @@ char* WWW_nameOfFile(const char* name) {
 **		found, else "".
 */
 const char* HTFileSuffix(HTAtom* rep) {
-	HTSuffix* suff;
-	int n;
-	int i;
+	HTRepSuffix* r;
 
 #ifndef NO_INIT
 	if(!HTSuffixes) HTFileInit();
 #endif
-	n = HTList_count(HTSuffixes);
-	for(i = 0; i < n; i++) {
-		suff = HTList_objectAt(HTSuffixes, i);
-		if(suff->rep == rep) {
-			return suff->suffix;        /* OK -- found */
-		}
+	for(r = rep_suffixes[REP_HASH(rep)]; r; r = r->next) {
+		if(r->rep == rep) return r->suffix->suffix;        /* OK -- found */
 	}
 	return "";        /* Dunno */
 }
@@ -420,35 +882,20 @@ const char* HTFileSuffix(HTAtom* rep) {
 
 HTFormat HTFileFormat(const char* filename, HTAtom** pencoding) {
 	HTSuffix* suff;
-	int n;
-	int i;
-	int lf = (int) strlen(filename);
+	size_t lf = strlen(filename);
 
 #ifndef NO_INIT
 	if(!HTSuffixes) HTFileInit();
 #endif
 	*pencoding = NULL;
-	n = HTList_count(HTSuffixes);
-	for(i = 0; i < n; i++) {
-		int ls;
-		suff = HTList_objectAt(HTSuffixes, i);
-		ls = (int) strlen(suff->suffix);
-		if((ls <= lf) && 0 == strcmp(suff->suffix, filename + lf - ls)) {
-			int j;
-			*pencoding = suff->encoding;
-			if(suff->rep) return suff->rep;        /* OK -- found */
-
-			for(j = 0; j < n; j++) {  /* Got encoding, need representation */
-				int ls2;
-				suff = HTList_objectAt(HTSuffixes, j);
-				ls2 = (int) strlen(suff->suffix);
-				if((ls <= lf) && 0 == strncmp(
-						suff->suffix, filename + lf - ls - ls2, ls2)) {
-					if(suff->rep) return suff->rep;
-				}
-			}
-
-		}
+	suff = trie_find(filename, lf);
+	if(suff) {
+		*pencoding = suff->encoding;
+		if(suff->rep) return suff->rep;        /* OK -- found */
+
+		/* Got encoding, need representation from the suffix before */
+		suff = trie_find(filename, lf - strlen(suff->suffix));
+		if(suff && suff->rep) return suff->rep;
 	}
 
 	/* defaults tree */
@@ -472,26 +919,18 @@ HTFormat HTFileFormat(const char* filename, HTAtom** pencoding) {
 
 float HTFileValue(const char* filename) {
 	HTSuffix* suff;
-	int n;
-	int i;
-	int lf = (int) strlen(filename);
 
 #ifndef NO_INIT
 	if(!HTSuffixes) HTFileInit();
 #endif
-	n = HTList_count(HTSuffixes);
-	for(i = 0; i < n; i++) {
-		int ls;
-		suff = HTList_objectAt(HTSuffixes, i);
-		ls = (int) strlen(suff->suffix);
-		if((ls <= lf) && 0 == strcmp(suff->suffix, filename + lf - ls)) {
-			if(TRACE) {
-				fprintf(
-						stderr, "File: Value of %s is %.3f\n", filename,
-						suff->quality);
-			}
-			return suff->quality;        /* OK -- found */
+	suff = trie_find(filename, strlen(filename));
+	if(suff) {
+		if(TRACE) {
+			fprintf(
+					stderr, "File: Value of %s is %.3f\n", filename,
+					suff->quality);
 		}
+		return suff->quality;        /* OK -- found */
 	}
 
 	return 0.3f;        /* Dunno! */
@@ -675,7 +1114,7 @@ int HTLoadFile(
 	HTFormat format;
 	char* nodename;
 	char* newname = 0;    /* Simplified name of file */
-	HTAtom* encoding;    /* @@ not used yet */
+	HTAtom* encoding;    /* From the suffix, or the variant chosen */
 
 /*	Reduce the filename to a basic form (hopefully unique!)
 */
@@ -724,79 +1163,91 @@ int HTLoadFile(
 		char* localname = HTLocalName(addr);
 		struct stat dir_info;
 
-#ifdef GOT_READ_DIR
+#ifdef CAN_READ_DIR
 
 		/*			  Multiformat handling
 		**
-		**	If needed, scan directory to find a good file.
-		**  Bug:  we don't stat the file to find the length
+		**	If needed, look through the variants in the directory
+		**	listing to find a good file. Each is valued for its
+		**	length, as HTStreamStack will choose the chain for it.
 		*/
 			if ( (strlen(localname) > strlen(MULTI_SUFFIX))
 			   && (0==strcmp(localname + strlen(localname) - strlen(MULTI_SUFFIX),
 							  MULTI_SUFFIX))) {
-				DIR *dp;
-
-				STRUCT_DIRENT * dirbuf;
+				HTDirListing* list;
+				HTVariant* variant;
+				HTVariant* best_variant = NULL;
 				float best = NO_VALUE_FOUND;	/* So far best is bad */
-				HTFormat best_rep = NULL;	/* Set when rep found */
-				STRUCT_DIRENT best_dirbuf;	/* Best dir entry so far */
 
 				char * base = strrchr(localname, '/');
-				int baselen;
+				size_t baselen;
 
 				if (!base || base == localname) goto forget_multi;
 				*base++ = 0;		/* Just got directory name */
 				baselen = strlen(base)- strlen(MULTI_SUFFIX);
 				base[baselen] = 0;	/* Chop off suffix */
 
-				dp = opendir(localname);
-				if (!dp) {
+				list = stat(localname, &dir_info) == 0 ?
+					get_listing(localname, &dir_info) : 0;
+				if (!list) {
 		forget_multi:
 				free(localname);
 				return HTLoadError(sink, 500,
 					"Multiformat: directory scan failed.");
 				}
 
-				while ((dirbuf = readdir(dp))!=0) {
-					/* while there are directory entries to be read */
-				if (dirbuf->d_ino == 0) continue;
-						/* if the entry is not being used, skip it */
-
-				if (dirbuf->d_namlen > baselen &&      /* Match? */
-					!strncmp(dirbuf->name, base, baselen)) {
-					HTFormat rep = HTFileFormat(dirbuf->name, &encoding);
-					float value = HTStackValue(rep, format_out,
-									HTFileValue(dirbuf->name),
-								0.0  /* @@@@@@ */);
+				for (variant = first_variant(list, base, baselen);
+					 variant < list->variants + list->variant_count &&
+					 !strncmp(list->arena + variant->name, base, baselen);
+					 variant++) {
+					float value;
+					char* variant_name = NULL;
+					struct stat variant_info;
+					long length = 0;
+
+					if (!list->arena[variant->name + baselen])
+						continue;	/* Must be longer than base */
+
+					StrAllocCopy(variant_name, localname);
+					StrAllocCat(variant_name, "/");
+					StrAllocCat(variant_name, list->arena + variant->name);
+					if (stat(variant_name, &variant_info) == 0)
+						length = (long) variant_info.st_size;
+					free(variant_name);
+
+					value = HTStackValue(variant->rep, format_out,
+									variant->quality, length);
 					if (value != NO_VALUE_FOUND) {
 						if (TRACE) fprintf(stderr,
 						"HTFile: value of presenting %s is %f\n",
-						HTAtom_name(rep), value);
+						HTAtom_name(variant->rep), value);
 					if  (value > best) {
-						best_rep = rep;
+						best_variant = variant;
 						best = value;
-						best_dirbuf = *dirbuf;
 					   }
 					}	/* if best so far */
-				 } /* if match */
-
-				} /* end while directory entries left to read */
-				closedir(dp);
+				}
 
-				if (best_rep) {
-				format = best_rep;
+				if (best_variant) {
+				format = best_variant->rep;
+				encoding = best_variant->encoding;
 				base[-1] = '/';		/* Restore directory name */
 				base[0] = 0;
-				StrAllocCat(localname, best_dirbuf.name);
+				StrAllocCat(localname, list->arena + best_variant->name);
+				release_listing(list);
 				goto open_file;
 
 				} else { 			/* If not found suitable file */
+				release_listing(list);
 				free(localname);
 				return HTLoadError(sink, 403,	/* List formats? */
 				   "Could not find suitable representation for transmission.");
 				}
 				/*NOTREACHED*/
 			} /* if multi suffix */
+#endif
+
+#ifdef GOT_READ_DIR
 		/*
 		**	Check to see if the 'localname' is in fact a directory. If it is
 		**	create a new hypertext object containing a list of files and
@@ -819,17 +1270,12 @@ int HTLoadFile(
 				/* if localname is a directory */
 
 				HTStructured* target;		/* HTML object */
-				HTStructuredClass targetClass;
 
-				DIR *dp;
-				STRUCT_DIRENT * dirbuf;
+				HTDirListing* list;
 
 				char * logical;
 				char * tail;
 
-				HTBool present[HTML_A_ATTRIBUTES];
-
-				char * tmpfilename = NULL;
 				struct stat file_info;
 
 				if (TRACE)
@@ -861,8 +1307,8 @@ int HTLoadFile(
 				}
 
 
-				dp = opendir(localname);
-				if (!dp) {
+				list = get_listing(localname, &dir_info);
+				if (!list) {
 					free(localname);
 					return HTLoadError(sink, 403, "This directory is not readable.");
 				}
@@ -874,117 +1320,38 @@ int HTLoadFile(
 				tail = strrchr(logical, '/') +1;	/* last part or "" */
 
 				target = HTML_new(anchor, format_out, sink);
-				targetClass = *target->isa;	/* Copy routine entry points */
-
-				  { int i;
-					for(i=0; i<HTML_A_ATTRIBUTES; i++)
-						present[i] = (i==HTML_A_HREF);
-				}
 
 						HTDirTitles(target, (HTAnchor *)anchor);
 
 						if (HTDirReadme == HT_DIR_README_TOP)
 					do_readme(target, localname);
 				{
-					HTBTree * bt = HTBTree_new((HTComparer)strcasecomp);
-
-					while ((dirbuf = readdir(dp))!=0)
-					{
-						HTBTElement * dirname = NULL;
-
-						/* while there are directory entries to be read */
-						if (dirbuf->d_ino == 0)
-						  /* if the entry is not being used, skip it */
-						continue;
-
-
-						/* if the current entry is parent directory */
-					if ((*(dirbuf->name)=='.') ||
-						(*(dirbuf->name)==','))
-						continue;    /* skip those files whose name begins
-					    with '.' or ',' */
-
-					dirname = (HTBTElement *)malloc(
-							strlen(dirbuf->name) + 2);
-					if (dirname == NULL) HTOOM(__FILE__,"DirRead");
-					StrAllocCopy(tmpfilename,localname);
-					if (strcmp(localname,"/"))
+					char state = 'I';	/* I for initial, D for directories,
+								   F for files */
+					int i;
 
-							/* if filename is not root directory */
-						StrAllocCat(tmpfilename,"/");
+					for(i = 0; i < list->count; i++) {
+						HTDirItem* item = &list->items[i];
 
-
-					StrAllocCat(tmpfilename,dirbuf->name);
-					stat(tmpfilename, &file_info);
-					if (((file_info.st_mode) & S_IFMT) == S_IFDIR)
-								sprintf((char *)dirname,"D%s",dirbuf->name);
-					else sprintf((char *)dirname,"F%s",dirbuf->name);
-						/* D & F to have first directories, then files */
-					HTBTree_add(bt,dirname); /* Sort dirname in the tree bt */
-					}
-
-					/*    Run through tree printing out in order
-					 */
-					{
-						HTBTElement * next_element = HTBTree_next(bt,NULL);
-						/* pick up the first element of the list */
-					char state;
-						/* I for initial (.. file),
-						   D for directory file,
-						   F for file */
-
-					state = 'I';
-
-					while (next_element)
-						{
-						StrAllocCopy(tmpfilename,localname);
-						if (strcmp(localname,"/"))
-
-							/* if filename is not root directory */
-							StrAllocCat(tmpfilename,"/");
-
-						StrAllocCat(tmpfilename,
-							(char *)HTBTree_object(next_element)+1);
-						/* append the current entry's filename to the path */
-						HTSimplify(tmpfilename);
-						/* Output the directory entry */
-						if (strcmp((char *)
-								 (HTBTree_object(next_element)),"D.."))
-						{
-						if (state != *(char *)(HTBTree_object(next_element)))
-						{
-							if (state == 'D')
-								END(HTML_DIR);
-							state = *(char *)
-								(HTBTree_object(next_element))=='D'?'D':'F';
+						if(state != item->kind) {
+							if(state == 'D') END(HTML_DIR);
+							state = item->kind;
 							START(HTML_H2);
-							PUTS(state == 'D'?"Subdirectories:":"Files");
+							PUTS(state == 'D' ? "Subdirectories:" : "Files");
 							END(HTML_H2);
 							START(HTML_DIR);
 						}
-							START(HTML_LI);
-						}
-						HTDirEntry(target, tail,
-							   (char*)HTBTree_object(next_element) +1);
-
-						next_element = HTBTree_next(bt,next_element);
-							/* pick up the next element of the list;
-						 if none, return NULL*/
+						START(HTML_LI);
+						HTDirEntry(target, tail, list->arena + item->name);
 					}
-					if (state == 'I')
-					{
+					if(state == 'I') {
 						START(HTML_P);
 						PUTS("Empty Directory");
 					}
-					else
-						END(HTML_DIR);
-					}
+					else END(HTML_DIR);
 
-						/* end while directory entries left to read */
-					closedir(dp);
 					free(logical);
-					free(tmpfilename);
-					HTBTreeAndObject_free(bt);
+					release_listing(list);
 
 					if (HTDirReadme == HT_DIR_README_BOTTOM)
 					  do_readme(target, localname);
@@ -999,6 +1366,8 @@ int HTLoadFile(
 
 		/* End of directory reading section
 		*/
+#endif
+#ifdef CAN_READ_DIR
 		open_file:
 #endif
 		{
@@ -1012,6 +1381,8 @@ int HTLoadFile(
 						(void*) fp);
 			}
 			if(fp) {        /* Good! */
+				struct stat file_info;
+
 				if(HTEditable(localname)) {
 					HTAtom* put = HTAtom_for("PUT");
 					HTList* methods = HTAnchor_methods(anchor);
@@ -1019,6 +1390,13 @@ int HTLoadFile(
 						HTList_addObject(methods, put);
 					}
 				}
+				if(fstat(fileno(fp), &file_info) == 0) {
+					HTAnchor_setLength(anchor, (long) file_info.st_size);
+				}
+				/* HTStreamStack puts in a decoder if one is needed */
+				if(HTCanInflate(encoding)) {
+					HTAnchor_setContentEncoding(anchor, encoding);
+				}
 				free(localname);
 				HTParseFile(format, format_out, anchor, fp, sink);
 				fclose(fp);
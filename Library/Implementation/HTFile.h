@@ -41,6 +41,8 @@ extern int HTDirReadme;         /* Include readme files in listing? */
 
 #define HT_DIR_README_FILE              "README"
 
+extern long HTDirCacheSize;     /* Bytes of directory listings to keep, 0 for none */
+
 
 /*
 
@@ -44,8 +44,11 @@ float HTMaxLength = 1e10;    /* No effective limit */
 #include <SGML.h>
 #include <HTML.h>
 #include <HTMLGen.h>
+#include <HTInflate.h>
+#include <HTWriter.h>
 
 HTBool HTOutputSource = HT_FALSE;    /* Flag: shortcut parser to stdout */
+long HTMapThreshold = 65536;    /* Map files at least this big */
 extern HTBool interactive;
 
 #ifdef ORIGINAL
@@ -69,6 +72,7 @@ struct _HTStream {
 
 HTList* HTPresentations = 0;
 HTPresentation* default_presentation = 0;
+long HTPresentationsVersion = 0;
 
 
 /*	Define a presentation system command for a content-type
@@ -92,6 +96,7 @@ void HTSetPresentation(
 	StrAllocCopy(pres->command, command);
 
 	if(!HTPresentations) HTPresentations = HTList_new();
+	HTPresentationsVersion++;
 
 	if(strcmp(representation, "*") == 0) {
 		if(default_presentation) free(default_presentation);
@@ -124,6 +129,7 @@ void HTSetConversion(
 	pres->command = 0;
 
 	if(!HTPresentations) HTPresentations = HTList_new();
+	HTPresentationsVersion++;
 
 	if(strcmp(representation_in, "*") == 0) {
 		if(default_presentation) free(default_presentation);
@@ -204,8 +210,414 @@ int HTOutputBinary(int input, FILE* output) {
 }
 
 
-/*		Create a filter stack
-**		---------------------
+/*		Conversion registry
+**		-------------------
+**
+**	HTPresentations is indexed by the (rep, rep_out) pair so that
+**	finding a converter does not mean scanning the list. The index is
+**	rebuilt when HTPresentationsVersion shows the list has changed.
+**
+**	The registry is also a graph: formats are the nodes and each pair
+**	with a converter is an edge. Where no one converter does the whole
+**	job, several are chained. The best chain for a pair is searched for
+**	once and kept on the pair's entry. The cost of a converter depends
+**	on the length of the data, so a chain is kept for each size class
+**	(power of two) asked about. Entries are made for pairs asked about
+**	even if nothing is registered for them, so a failure is kept too.
+*/
+#define MAX_HOPS 4        /* Longest chain of converters tried */
+#define SIZE_CLASSES 33        /* 0 for unknown, else 1 + log2(length) */
+
+typedef struct _HTChain HTChain;
+
+struct _HTChain {
+	HTChain* next;        /* Chain for another size class */
+	int size_class;
+	int hops;        /* Number of steps, 0 if no way */
+	HTPresentation* step[MAX_HOPS];    /* Converters, first applied first */
+	HTFormat via[MAX_HOPS + 1];    /* Format before each step, then after */
+};
+
+typedef struct _HTConversion HTConversion;
+
+struct _HTConversion {
+	HTConversion* next;        /* Next in hash chain */
+	HTFormat rep_in;
+	HTFormat rep_out;
+	HTPresentation* first;        /* First in HTPresentations, if any */
+	HTPresentation* last;        /* Last in HTPresentations, if any */
+	int from;        /* Node numbers, if an edge of the graph */
+	int to;
+	HTChain* chains;        /* Found so far, one per size class */
+};
+
+#define REGISTRY_MIN_SIZE 64    /* Must be a power of two */
+
+static HTConversion** registry = NULL;    /* Hash table of chains */
+static int registry_size = 0;
+static int registry_count = 0;
+static long registry_version = -1;    /* HTPresentationsVersion indexed */
+
+static HTFormat* nodes = NULL;        /* Every concrete format mentioned */
+static int node_count = 0;
+static HTConversion** edges = NULL;    /* Every concrete pair registered */
+static int edge_count = 0;
+
+static HTAtom* wildcard_atom = NULL;    /* HTAtom_for("*") */
+static HTAtom* source_atom = NULL;        /* WWW_SOURCE */
+static HTAtom* mime_atom = NULL;        /* WWW_MIME */
+
+
+static unsigned int pair_hash(HTFormat rep_in, HTFormat rep_out) {
+	size_t h = ((size_t) rep_in >> 3) * 31 + ((size_t) rep_out >> 3);
+	return (unsigned int) (h ^ (h >> 15));
+}
+
+
+static void registry_grow(void) {
+	int new_size = registry_size ? registry_size * 2 : REGISTRY_MIN_SIZE;
+	HTConversion** table = calloc(new_size, sizeof(HTConversion*));
+	int i;
+	if(table == NULL) HTOOM(__FILE__, "registry_grow");
+
+	for(i = 0; i < registry_size; i++) {
+		HTConversion* c = registry[i];
+		while(c) {
+			HTConversion* next = c->next;
+			unsigned int h = pair_hash(c->rep_in, c->rep_out) & (new_size - 1);
+			c->next = table[h];
+			table[h] = c;
+			c = next;
+		}
+	}
+	free(registry);
+	registry = table;
+	registry_size = new_size;
+}
+
+
+/*	Find the entry for a pair, making it if need be
+*/
+static HTConversion* registry_find(
+		HTFormat rep_in, HTFormat rep_out, HTBool create) {
+	HTConversion* c;
+	unsigned int h;
+
+	if(!registry_size) {
+		if(!create) return NULL;
+		registry_grow();
+	}
+	h = pair_hash(rep_in, rep_out) & (registry_size - 1);
+	for(c = registry[h]; c; c = c->next) {
+		if(c->rep_in == rep_in && c->rep_out == rep_out) return c;
+	}
+	if(!create) return NULL;
+
+	if(registry_count >= registry_size) {        /* Keep chains short */
+		registry_grow();
+		h = pair_hash(rep_in, rep_out) & (registry_size - 1);
+	}
+	c = malloc(sizeof(*c));
+	if(c == NULL) HTOOM(__FILE__, "registry_find");
+	c->rep_in = rep_in;
+	c->rep_out = rep_out;
+	c->first = c->last = NULL;
+	c->from = c->to = -1;
+	c->chains = NULL;
+	c->next = registry[h];
+	registry[h] = c;
+	registry_count++;
+	return c;
+}
+
+
+static void registry_clear(void) {
+	int i;
+	for(i = 0; i < registry_size; i++) {
+		while(registry[i]) {
+			HTConversion* c = registry[i];
+			registry[i] = c->next;
+			while(c->chains) {
+				HTChain* chain = c->chains;
+				c->chains = chain->next;
+				free(chain);
+			}
+			free(c);
+		}
+	}
+	registry_count = 0;
+	free(nodes);
+	free(edges);
+	nodes = NULL;
+	edges = NULL;
+	node_count = edge_count = 0;
+}
+
+
+/*	Number a format as a node of the graph
+*/
+static int node_for(HTFormat format) {
+	int i;
+	for(i = 0; i < node_count; i++) {
+		if(nodes[i] == format) return i;
+	}
+	nodes[node_count] = format;
+	return node_count++;
+}
+
+
+/*	Make sure the index matches HTPresentations
+*/
+static void registry_update(void) {
+	HTList* cur;
+	HTPresentation* pres;
+	int n;
+	int i;
+
+	if(!wildcard_atom) {
+		wildcard_atom = HTAtom_for("*");
+		source_atom = WWW_SOURCE;
+		mime_atom = WWW_MIME;
+	}
+	if(!HTPresentations) HTFormatInit();    /* set up the list */
+	if(registry_version == HTPresentationsVersion) return;
+
+	if(TRACE) fprintf(stderr, "HTFormat: Indexing conversions\n");
+	registry_clear();
+	n = 0;
+	cur = HTPresentations;
+	while((pres = HTList_nextObject(cur))) {
+		HTConversion* c = registry_find(pres->rep, pres->rep_out, HT_TRUE);
+		if(!c->first) c->first = pres;
+		c->last = pres;
+		n++;
+	}
+
+	/* The edges are the pairs with no wildcard in */
+	nodes = malloc((2 * n + 1) * sizeof(HTFormat));
+	edges = malloc((n + 1) * sizeof(HTConversion*));
+	if(nodes == NULL || edges == NULL) HTOOM(__FILE__, "registry_update");
+	for(i = 0; i < registry_size; i++) {
+		HTConversion* c;
+		for(c = registry[i]; c; c = c->next) {
+			if(c->rep_out == wildcard_atom) {
+				(void) node_for(c->rep_in);
+				continue;
+			}
+			c->from = node_for(c->rep_in);
+			c->to = node_for(c->rep_out);
+			edges[edge_count++] = c;
+		}
+	}
+	registry_version = HTPresentationsVersion;
+}
+
+
+/*	The last registered for a pair, if any
+*/
+static HTPresentation* registry_last(HTFormat rep_in, HTFormat rep_out) {
+	HTConversion* c = registry_find(rep_in, rep_out, HT_FALSE);
+	return c ? c->last : NULL;
+}
+
+
+/*	Size classes
+**
+**	Class 0 is unknown length; class k stands for 2^(k-1) bytes or more.
+*/
+static int size_class(long int length) {
+	int sc = 0;
+	while(length > 0 && sc < SIZE_CLASSES - 1) {
+		length >>= 1;
+		sc++;
+	}
+	return sc;
+}
+
+static long int class_length(int sc) {
+	return sc ? 1L << (sc - 1) : 0L;
+}
+
+
+/*	Value of data after one conversion step
+**
+**	This is the formula HTStackValue has always used for one converter.
+*/
+static float step_value(HTPresentation* pres, float value, long int length) {
+	value = value * pres->quality;
+	if(HTMaxSecs != 0.0) {
+		value = value - (length * pres->secs_per_byte + pres->secs) / HTMaxSecs;
+	}
+	return value;
+}
+
+
+/*	Find the best chain of converters
+**	---------------------------------
+**
+**	Bellman-Ford over at most MAX_HOPS steps: best[k][n] is the best value
+**	of format n which can be had in k steps or fewer. A value is only
+**	replaced by a strictly better one, so of two chains which are as good
+**	the shorter is kept. Converters to "*" can only be the last step, as
+**	they need to be told what to produce. If nothing else will do, the
+**	www/source converters are used as before.
+*/
+#define NO_WAY (-1e30f)
+
+static void find_chain(HTChain* chain, HTFormat rep_in, HTFormat rep_out) {
+	float* best = malloc((MAX_HOPS + 1) * node_count * sizeof(float) + 1);
+	HTConversion** pred = malloc(
+			(MAX_HOPS + 1) * node_count * sizeof(HTConversion*) + 1);
+	long int length = class_length(chain->size_class);
+	int start = -1;
+	int target = -1;
+	float best_value = NO_WAY;
+	int best_node = -1;        /* Where the chain of edges ends */
+	int best_layer = 0;
+	HTPresentation* last_step = NULL;    /* Wildcard converter after that */
+	int k;
+	int i;
+
+	if(best == NULL || pred == NULL) HTOOM(__FILE__, "find_chain");
+	chain->hops = 0;
+
+	for(i = 0; i < node_count; i++) {
+		if(nodes[i] == rep_in) start = i;
+		if(nodes[i] == rep_out) target = i;
+	}
+
+	if(start >= 0) {
+		for(i = 0; i < node_count; i++) {
+			best[i] = NO_WAY;
+			pred[i] = NULL;
+		}
+		best[start] = 1.0f;
+
+		for(k = 1; k <= MAX_HOPS; k++) {
+			float* now = best + k * node_count;
+			float* before = best + (k - 1) * node_count;
+			HTConversion** came = pred + k * node_count;
+			for(i = 0; i < node_count; i++) {
+				now[i] = before[i];
+				came[i] = NULL;        /* NULL: same as the layer before */
+			}
+			for(i = 0; i < edge_count; i++) {
+				HTConversion* e = edges[i];
+				float value;
+				if(before[e->from] == NO_WAY) continue;
+				value = step_value(e->first, before[e->from], length);
+				if(value > now[e->to]) {
+					now[e->to] = value;
+					came[e->to] = e;
+				}
+			}
+		}
+
+		if(target >= 0 && best[MAX_HOPS * node_count + target] != NO_WAY) {
+			best_value = best[MAX_HOPS * node_count + target];
+			best_node = target;
+			best_layer = MAX_HOPS;
+		}
+
+		/* Or get somewhere which has a converter to anything */
+		for(i = 0; i < node_count; i++) {
+			float before = best[(MAX_HOPS - 1) * node_count + i];
+			HTPresentation* pres;
+			float value;
+			if(before == NO_WAY) continue;
+			pres = registry_last(nodes[i], wildcard_atom);
+			if(!pres) continue;
+			value = step_value(pres, before, length);
+			if(value > best_value) {
+				best_value = value;
+				best_node = i;
+				best_layer = MAX_HOPS - 1;
+				last_step = pres;
+			}
+		}
+	}
+
+	if(best_node >= 0) {
+		HTPresentation* steps[MAX_HOPS];
+		HTFormat via[MAX_HOPS + 1];
+		int n = 0;
+		int node = best_node;
+
+		if(last_step) {
+			steps[n] = last_step;
+			via[n++] = rep_out;
+		}
+		for(k = best_layer; k > 0; k--) {
+			HTConversion* e = pred[k * node_count + node];
+			if(!e) continue;        /* Got here in fewer steps */
+			steps[n] = e->first;
+			via[n++] = e->rep_out;
+			node = e->from;
+		}
+
+		/* They were found backwards */
+		chain->hops = n;
+		for(i = 0; i < n; i++) {
+			chain->step[i] = steps[n - 1 - i];
+			chain->via[i + 1] = via[n - 1 - i];
+		}
+		chain->via[0] = rep_in;
+	}
+	else {            /* www/source can take anything */
+		HTPresentation* pres = registry_last(source_atom, rep_out);
+		if(!pres) pres = registry_last(source_atom, wildcard_atom);
+		if(pres) {
+			chain->hops = 1;
+			chain->step[0] = pres;
+			chain->via[0] = rep_in;
+			chain->via[1] = rep_out;
+		}
+	}
+
+	free(best);
+	free(pred);
+}
+
+
+/*	The chain for a pair and a length
+*/
+static HTChain* chain_for(HTFormat rep_in, HTFormat rep_out, long int length) {
+	HTConversion* c = registry_find(rep_in, rep_out, HT_TRUE);
+	int sc = size_class(length);
+	HTChain* chain;
+
+	for(chain = c->chains; chain; chain = chain->next) {
+		if(chain->size_class == sc) return chain;
+	}
+
+	chain = malloc(sizeof(*chain));
+	if(chain == NULL) HTOOM(__FILE__, "chain_for");
+	chain->size_class = sc;
+	find_chain(chain, rep_in, rep_out);
+	chain->next = c->chains;
+	c->chains = chain;
+
+	if(TRACE) {
+		int i;
+		fprintf(
+				stderr, "HTFormat: %s to %s (size class %d) in %d step%s:",
+				HTAtom_name(rep_in), HTAtom_name(rep_out), sc,
+				chain->hops, chain->hops == 1 ? "" : "s");
+		for(i = 0; i < chain->hops; i++) {
+			fprintf(stderr, " %s", HTAtom_name(chain->via[i + 1]));
+		}
+		fprintf(stderr, "\n");
+	}
+	return chain;
+}
+
+
+/*		Create a filter stack for the data
+**		----------------------------------
+**
+**	The stack is built from the sink upwards, one converter for each
+**	step of the chain. The chain is the one HTStackValue would value
+**	for the length the anchor gives.
 **
 **	If a wildcard match is made, a temporary HTPresentation
 **	structure is made to hold the destination format while the
@@ -214,65 +626,80 @@ int HTOutputBinary(int input, FILE* output) {
 **	be a lot neater.
 **
 **	The www/source format is special, in that if you can take
-**	that you can take anything. However, we
+**	that you can take anything.
 */
-HTStream* HTStreamStack(
+static HTStream* format_stack(
 		HTFormat rep_in, HTFormat rep_out, HTStream* sink,
 		HTParentAnchor* anchor) {
-	HTAtom* wildcard = HTAtom_for("*");
-	HTFormat source = WWW_SOURCE;
+	HTChain* chain;
+	HTStream* stream = sink;
+	int i;
+
 	if(TRACE) {
 		fprintf(
 				stderr, "HTFormat: Constructing stream stack for %s to %s\n",
 				HTAtom_name(rep_in), HTAtom_name(rep_out));
 	}
 
-	if(rep_out == WWW_SOURCE || rep_out == rep_in) return sink;
+	registry_update();
+	if(rep_out == source_atom || rep_out == rep_in) return sink;
 
-	if(!HTPresentations) HTFormatInit();    /* set up the list */
+	chain = chain_for(rep_in, rep_out, HTAnchor_length(anchor));
+	if(!chain->hops) {
+#ifdef XMOSAIC_HACK_REMOVED_NOW  /* Use above source method instead */
+		return sink;
+#else
+		return 0;
+#endif
+	}
 
-	{
-		int n = HTList_count(HTPresentations);
-		int i;
-		HTPresentation* pres, * match, * wildcard_match = 0, * source_match = 0, * source_wildcard_match = 0;
-		for(i = 0; i < n; i++) {
-			pres = HTList_objectAt(HTPresentations, i);
-			if(pres->rep == rep_in) {
-				if(pres->rep_out == rep_out) {
-					return (*pres->converter)(pres, anchor, sink);
-				}
-				if(pres->rep_out == wildcard) {
-					wildcard_match = pres;
-				}
-			}
-			if(pres->rep == source) {
-				if(pres->rep_out == rep_out) {
-					source_match = pres;
-				}
-				if(pres->rep_out == wildcard) {
-					source_wildcard_match = pres;
-				}
-			}
+	for(i = chain->hops - 1; i >= 0; i--) {
+		HTPresentation* pres = chain->step[i];
+		if(pres->rep == chain->via[i] && pres->rep_out == chain->via[i + 1]) {
+			stream = (*pres->converter)(pres, anchor, stream);
 		}
-
-		match = wildcard_match ? wildcard_match : source_match ? source_match
-															   : source_wildcard_match;
-
-		if(match) {
+		else {
 			HTPresentation temp;
-			temp = *match;            /* Specific instance */
-			temp.rep = rep_in;        /* yuk */
-			temp.rep_out = rep_out;        /* yuk */
-			return (*match->converter)(&temp, anchor, sink);
+			temp = *pres;            /* Specific instance */
+			temp.rep = chain->via[i];        /* yuk */
+			temp.rep_out = chain->via[i + 1];        /* yuk */
+			stream = (*pres->converter)(&temp, anchor, stream);
+		}
+		if(!stream) {
+			if(TRACE) {
+				fprintf(
+						stderr, "HTFormat: Converter to %s failed\n",
+						HTAtom_name(chain->via[i + 1]));
+			}
+			return 0;
 		}
 	}
+	return stream;
+}
 
 
-#ifdef XMOSAIC_HACK_REMOVED_NOW  /* Use above source method instead */
-	return sink;
-#else
-	return 0;
-#endif
+/*		Create a filter stack
+**		---------------------
+**
+**	This is the format stack above, with a Content-Encoding decoder on
+**	top if the anchor says its body is compressed. The encoding is then
+**	cleared on the anchor so that stacks built further down for the same
+**	anchor don't decode a second time.
+**
+**	A www/mime stack is built before the headers have been read, so it
+**	is the stack which the MIME parser builds for the body which decodes.
+*/
+HTStream* HTStreamStack(
+		HTFormat rep_in, HTFormat rep_out, HTStream* sink,
+		HTParentAnchor* anchor) {
+	HTStream* stream = format_stack(rep_in, rep_out, sink, anchor);
+	HTEncoding encoding = HTAnchor_contentEncoding(anchor);
+
+	if(!stream || !encoding || rep_in == mime_atom) return stream;
+	if(!HTCanInflate(encoding)) return stream;
+
+	HTAnchor_setContentEncoding(anchor, NULL);
+	return HTInflate(encoding, stream);
 }
 
 
@@ -287,7 +714,9 @@ HTStream* HTStreamStack(
 float HTStackValue(
 		HTFormat rep_in, HTFormat rep_out, float initial_value,
 		long int length) {
-	HTAtom* wildcard = HTAtom_for("*");
+	HTChain* chain;
+	float value = initial_value;
+	int i;
 
 	if(TRACE) {
 		fprintf(
@@ -296,27 +725,15 @@ float HTStackValue(
 				HTAtom_name(rep_in), initial_value, HTAtom_name(rep_out));
 	}
 
-	if(rep_out == WWW_SOURCE || rep_out == rep_in) return 0.0;
+	registry_update();
+	if(rep_out == source_atom || rep_out == rep_in) return 0.0;
 
-	if(!HTPresentations) HTFormatInit();    /* set up the list */
-
-	{
-		int n = HTList_count(HTPresentations);
-		int i;
-		HTPresentation* pres;
-		for(i = 0; i < n; i++) {
-			pres = HTList_objectAt(HTPresentations, i);
-			if(pres->rep == rep_in &&
-			   (pres->rep_out == rep_out || pres->rep_out == wildcard)) {
-				float value = initial_value * pres->quality;
-				if(HTMaxSecs != 0.0) {
-					value = value -
-							(length * pres->secs_per_byte + pres->secs) /
-							HTMaxSecs;
-				}
-				return value;
-			}
+	chain = chain_for(rep_in, rep_out, length);
+	if(chain->hops) {
+		for(i = 0; i < chain->hops; i++) {
+			value = step_value(chain->step[i], value, length);
 		}
+		return value;
 	}
 
 	return -1e30f; /* Really bad */
@@ -373,17 +790,95 @@ void HTCopy(int file_number, HTStream* sink) {
 }
 
 
+/*	Write several blocks down a stream
+**	----------------------------------
+**
+**	Streams which can't take them all at once get them one at a time.
+*/
+void HTPutIovec(HTStream* sink, const HTIovec* iov, int count) {
+	int i;
+
+	if(sink->isa->put_iovec) {
+		(*sink->isa->put_iovec)(sink, iov, count);
+		return;
+	}
+	for(i = 0; i < count; i++) {
+		if(iov[i].len > 0) (*sink->isa->put_block)(sink, iov[i].base, iov[i].len);
+	}
+}
+
+
+/*	Push a file down a stream through a memory map
+**	----------------------------------------------
+**
+**	Files of HTMapThreshold bytes or more are mapped in windows of
+**	MAP_WINDOW bytes, each going down the stream in a single put_block.
+**	Returns HT_FALSE if the rest of the file must be read instead, with
+**	fp left at the first byte which was not sent.
+*/
+#ifndef _WIN32
+
+#define MAP_WINDOW (16L * 1024L * 1024L)    /* A multiple of any page size */
+
+static HTBool map_copy(FILE* fp, HTStream* sink) {
+	struct stat status;
+	long start = ftell(fp);
+	long page = sysconf(_SC_PAGESIZE);
+	long offset, skip;
+	int fd = fileno(fp);
+
+	if(HTMapThreshold <= 0 || start < 0 || page <= 0 || fd < 0) return HT_FALSE;
+	if(fstat(fd, &status) < 0 || !S_ISREG(status.st_mode)) return HT_FALSE;
+	if(status.st_size - start < HTMapThreshold) return HT_FALSE;
+
+	skip = start % page;    /* Maps must start on a page boundary */
+	for(offset = start - skip; offset < status.st_size; offset += MAP_WINDOW) {
+		long length = status.st_size - offset;
+		char* map;
+
+		if(length > MAP_WINDOW) length = MAP_WINDOW;
+		map = mmap(0, (size_t) length, PROT_READ, MAP_PRIVATE, fd, offset);
+		if(map == MAP_FAILED) {
+			if(TRACE) fprintf(stderr, "HTFormat: Can't map file, reading\n");
+			fseek(fp, offset + skip, SEEK_SET);
+			return HT_FALSE;
+		}
+#ifdef MADV_SEQUENTIAL
+		madvise(map, (size_t) length, MADV_SEQUENTIAL);
+#endif
+		(*sink->isa->put_block)(sink, map + skip, (int) (length - skip));
+		munmap(map, (size_t) length);
+		skip = 0;
+	}
+	fseek(fp, 0, SEEK_END);
+	return HT_TRUE;
+}
+
+#endif /* _WIN32 */
+
+
 /*	Push data from a file pointer down a stream
 **	-------------------------------------
 **
 **   This routine is responsible for creating and PRESENTING any
 **   graphic (or other) objects described by the file.
 **
-**
+**   If the sink is a socket writer, so that no conversion is needed,
+**   the file is sent with sendfile() where the system has it.
+**   Otherwise big files are mapped into memory rather than read.
 */
 void HTFileCopy(FILE* fp, HTStream* sink) {
 	HTStreamClass targetClass;
 
+	/*	A socket with nothing in front of it can be given the file
+	**	without copying it through our buffer.
+	*/
+	if(HTWriter_sendFile(sink, fp)) return;
+
+#ifndef _WIN32
+	if(map_copy(fp, sink)) return;
+#endif
+
 /*	Push the data down the stream
 **
 */
@@ -589,7 +1084,7 @@ static void NetToText_abort(HTStream* me, HTError e) {
 */
 static HTStreamClass NetToTextClass = {
 		"NetToText", NetToText_free, NetToText_abort, NetToText_put_character,
-		NetToText_put_string, NetToText_put_block };
+		NetToText_put_string, NetToText_put_block, NULL };
 
 /*	The creation method
 */
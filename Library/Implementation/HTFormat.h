@@ -110,6 +110,15 @@ typedef HTAtom* HTEncoding;
  */
 #define WWW_ENC_COMPRESS        HTAtom_for("compress")
 
+/*
+
+   and the HTTP Content-Encodings which HTInflate can undo.
+
+ */
+#define WWW_ENC_GZIP            HTAtom_for("gzip")
+#define WWW_ENC_X_GZIP          HTAtom_for("x-gzip")
+#define WWW_ENC_DEFLATE         HTAtom_for("deflate")
+
 #include <HTAnchor.h>
 
 /*
@@ -146,6 +155,15 @@ struct _HTPresentation {
  */
 extern HTList* HTPresentations;
 
+/*
+
+   HTPresentationsVersion is changed every time a presentation or conversion is
+   registered, so that modules which keep things worked out from the list can tell when
+   to work them out again.
+   
+ */
+extern long HTPresentationsVersion;
+
 /*
 
 HTSetPresentation: Register a system command to present a format
@@ -191,13 +209,20 @@ void HTSetConversion(
 
 HTStreamStack:   Create a stack of streams
 
-   This is the routine which actually sets up the conversion. It currently checks only for
-   direct conversions, but multi-stage conversions are forseen. It takes a stream into
+   This is the routine which actually sets up the conversion. If no one converter does the
+   job, a chain of up to four is used, chosen for the best value as worked out by
+   HTStackValue. It takes a stream into
    which the output should be sent in the final format, builds the conversion stack, and
    returns a stream into which the data in the input format should be fed. The anchor is
    passed because hypertxet objects load information into the anchor object which
    represents them.
    
+   The chain is chosen for the length of the body given by HTAnchor_length, so it is the
+   one HTStackValue values when given that length.
+   
+   If the anchor has a Content-Encoding set which HTInflate can undo, a decoder is put on
+   top of the stack.
+   
  */
 HTStream* HTStreamStack(
 		HTFormat format_in, HTFormat format_out, HTStream* stream_out,
@@ -207,7 +232,9 @@ HTStream* HTStreamStack(
 
 HTStackValue: Find the cost of a filter stack
 
-   Must return the cost of the same stack which HTStreamStack would set up.
+   Must return the cost of the same stack which HTStreamStack would set up. For a chain,
+   the value is put through each converter in turn. The best chain may depend on the
+   length, so one is kept for each power of two.
    
   ON ENTRY,
   
@@ -240,6 +267,17 @@ void HTCopy(
 		int file_number, HTStream* sink);
 
 
+/*
+
+HTPutIovec:  Write several blocks down a stream
+
+   This calls the stream's put_iovec method if it has one, and otherwise put_block for
+   each block in turn.
+   
+ */
+void HTPutIovec(HTStream* sink, const HTIovec* iov, int count);
+
+
 /*
 
 HTFileCopy:  Copy a file to a stream
@@ -247,6 +285,13 @@ HTFileCopy:  Copy a file to a stream
    This is used by the protocol engines to send data down a stream, typically one which
    has been generated by HTStreamStack. It is currently called by HTParseFile
    
+   When the sink is a socket writer, so that nothing needs converting, the file is sent
+   to the socket with sendfile() where the system has it (see HTWriter.h).
+   
+   Otherwise a file with at least HTMapThreshold bytes still to go is mapped into memory
+   and passed down in a few big blocks instead of being read. Set HTMapThreshold to 0 to
+   turn this off.
+   
  */
 void HTFileCopy(FILE* fp, HTStream* sink);
 
@@ -336,6 +381,7 @@ Epilogue
 
  */
 extern HTBool HTOutputSource;     /* Flag: shortcut parser */
+extern long HTMapThreshold;       /* Smallest file to map, 0 for never */
 #endif
 
 /*
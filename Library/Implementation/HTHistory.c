@@ -5,6 +5,23 @@
 static HTList* history;    /* List of visited anchors */
 
 
+/*	Anchors in the history are kept from being collected
+*/
+static void push(HTAnchor* anchor) {
+	if(!history) {
+		history = HTList_new();
+	}
+	HTAnchor_keep(anchor);
+	HTList_addObject(history, anchor);
+}
+
+static HTAnchor* pop(void) {
+	HTAnchor* anchor = HTList_removeLastObject(history);
+	HTAnchor_unkeep(anchor);
+	return anchor;
+}
+
+
 /*				Navigation
 **				==========
 */
@@ -15,10 +32,7 @@ static HTList* history;    /* List of visited anchors */
 
 void HTHistory_record(HTAnchor* destination) {
 	if(destination) {
-		if(!history) {
-			history = HTList_new();
-		}
-		HTList_addObject(history, destination);
+		push(destination);
 	}
 }
 
@@ -30,7 +44,7 @@ HTAnchor*
 HTHistory_backtrack(void)  /* FIXME: Should we add a `sticky' option ? */
 {
 	if(HTHistory_canBacktrack()) {
-		HTList_removeLastObject(history);
+		pop();
 	}
 	return HTList_lastObject (history);  /* is Home if can't backtrack */
 }
@@ -58,10 +72,10 @@ HTAnchor* HTHistory_moveBy(int offset) {
 		if(nextOne) {
 			HTAnchor* destination = HTAnchor_followMainLink(nextOne);
 			if(destination) {
-				HTList_removeLastObject(history);
-				HTList_removeLastObject(history);
-				HTList_addObject(history, nextOne);
-				HTList_addObject(history, destination);
+				pop();
+				pop();
+				push(nextOne);
+				push(destination);
 			}
 			return destination;
 		}
@@ -118,7 +132,7 @@ HTAnchor* HTHistory_recall(int number) {
 	HTAnchor* destination = HTList_objectAt(
 			history, HTList_count(history) - number);
 	if(destination && destination != HTList_lastObject (history)) {
-		HTList_addObject(history, destination);
+		push(destination);
 	}
 	return destination;
 }
@@ -144,8 +158,8 @@ int HTHistory_count
 */
 
 void HTHistory_leavingFrom(HTAnchor* anchor) {
-	if(HTList_removeLastObject(history)) {
-		HTList_addObject(history, anchor);
+	if(pop()) {
+		push(anchor);
 	}
 	else if(TRACE) fprintf(stderr, "HTHistory_leavingFrom: empty history !\n");
 }
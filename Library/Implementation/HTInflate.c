@@ -0,0 +1,285 @@
+/*		Content-Encoding decoder			HTInflate.c
+**		========================
+**
+**	This stream inflates a body sent with Content-Encoding gzip or
+**	deflate. Input is fed to zlib as it arrives and the output is
+**	passed down in blocks of OUTPUT_BUFFER_SIZE, which keeps the
+**	number of calls on the rest of the stream stack small.
+**
+**	"deflate" is meant to be zlib format, but some servers send a raw
+**	deflate stream. If the first bytes don't have a zlib header we
+**	start again in raw mode. Callers may feed the start of the body a
+**	character at a time, so everything fed in is kept until output
+**	starts, to be fed again.
+**
+** Bugs:
+**	Only one encoding is handled: "gzip, deflate" stacked is not.
+*/
+
+/* Implements:
+*/
+#include <HTInflate.h>
+
+#include <HTUtils.h>
+#include <HTSTD.h>
+
+#ifdef GOT_ZLIB
+
+#include <zlib.h>
+
+#define OUTPUT_BUFFER_SIZE 32768    /* Tradeoff */
+
+const char* HTAcceptEncodings = "gzip, deflate";
+
+/*		Inflate Object
+**		--------------
+*/
+
+struct _HTStream {
+	const HTStreamClass* isa;
+
+	HTStream* sink;
+	HTStreamClass targetClass;    /* COPY for speed */
+
+	z_stream z;
+	HTBool raw;        /* Retried as raw deflate? */
+	HTBool started;    /* Has any output been produced? */
+	HTBool finished;    /* End of compressed data seen */
+	HTBool failed;        /* Give up: data is corrupt */
+	char* held;        /* Input kept until output starts or raw */
+	int held_length;
+	int held_size;
+	char buffer[OUTPUT_BUFFER_SIZE];
+};
+
+
+/*	Is this an encoding we can decode?
+**	----------------------------------
+*/
+HTBool HTCanInflate(HTEncoding encoding) {
+	return encoding == WWW_ENC_GZIP || encoding == WWW_ENC_X_GZIP ||
+		   encoding == WWW_ENC_DEFLATE;
+}
+
+
+/*	Start again as raw deflate
+**	--------------------------
+**
+**	Only done before any output has been produced, while everything
+**	fed in is still held to be fed again.
+*/
+static HTBool restart_raw(HTStream* me) {
+	inflateEnd(&me->z);
+	memset(&me->z, 0, sizeof(me->z));
+	if(inflateInit2(&me->z, -MAX_WBITS) != Z_OK) return HT_FALSE;
+	me->raw = HT_TRUE;
+	if(TRACE) fprintf(stderr, "HTInflate: No zlib header, trying raw\n");
+	return HT_TRUE;
+}
+
+
+/*_________________________________________________________________________
+**
+**			A C T I O N 	R O U T I N E S
+*/
+
+/*	Hold input until it is known how to decode it
+**	---------------------------------------------
+*/
+static void hold(HTStream* me, const char* s, int l) {
+	if(me->held_length + l > me->held_size) {
+		me->held_size = (me->held_length + l) * 2;
+		me->held = realloc(me->held, (size_t) me->held_size);
+		if(me->held == NULL) HTOOM(__FILE__, "HTInflate hold");
+	}
+	memcpy(me->held + me->held_length, s, (size_t) l);
+	me->held_length += l;
+}
+
+static void release(HTStream* me) {
+	free(me->held);
+	me->held = 0;
+	me->held_length = me->held_size = 0;
+}
+
+
+/*	Inflate what is fed in
+**	----------------------
+*/
+static void inflate_block(HTStream* me, const char* s, int l) {
+	me->z.next_in = (Bytef*) s;
+	me->z.avail_in = (uInt) l;
+
+	while(me->z.avail_in > 0) {
+		int status;
+
+		me->z.next_out = (Bytef*) me->buffer;
+		me->z.avail_out = OUTPUT_BUFFER_SIZE;
+		status = inflate(&me->z, Z_NO_FLUSH);
+
+		if(status == Z_DATA_ERROR && !me->raw && !me->started) {
+			if(!restart_raw(me)) {
+				me->failed = HT_TRUE;
+				return;
+			}
+			me->z.next_in = (Bytef*) me->held;    /* Feed it all again */
+			me->z.avail_in = (uInt) me->held_length;
+			continue;
+		}
+
+		if(me->z.avail_out < OUTPUT_BUFFER_SIZE) {
+			me->started = HT_TRUE;
+			(*me->targetClass.put_block)(
+					me->sink, me->buffer,
+					(int) (OUTPUT_BUFFER_SIZE - me->z.avail_out));
+		}
+
+		if(status == Z_STREAM_END) {
+			me->finished = HT_TRUE;
+			return;
+		}
+		if(status != Z_OK && status != Z_BUF_ERROR) {
+			if(TRACE) {
+				fprintf(
+						stderr, "HTInflate: inflate() returns %d (%s)\n",
+						status, me->z.msg ? me->z.msg : "");
+			}
+			me->failed = HT_TRUE;
+			return;
+		}
+		if(status == Z_BUF_ERROR && me->z.avail_out != 0) return;
+	}
+
+	/* Input used up: drain anything zlib still holds */
+	while(!me->finished) {
+		int status;
+
+		me->z.next_out = (Bytef*) me->buffer;
+		me->z.avail_out = OUTPUT_BUFFER_SIZE;
+		status = inflate(&me->z, Z_NO_FLUSH);
+		if(me->z.avail_out == OUTPUT_BUFFER_SIZE) break;
+		(*me->targetClass.put_block)(
+				me->sink, me->buffer,
+				(int) (OUTPUT_BUFFER_SIZE - me->z.avail_out));
+		if(status == Z_STREAM_END) me->finished = HT_TRUE;
+		else if(status != Z_OK) break;
+	}
+}
+
+
+/*	Buffer write. Buffers can (and should!) be big.
+**	------------
+*/
+static void HTInflate_write(HTStream* me, const char* s, int l) {
+	if(me->finished || me->failed || l <= 0) return;
+
+	if(!me->raw && !me->started) {
+		hold(me, s, l);
+		s = me->held + me->held_length - l;
+	}
+	inflate_block(me, s, l);
+	if(me->held && (me->raw || me->started || me->finished || me->failed)) {
+		release(me);
+	}
+}
+
+
+/*	Character handling
+**	------------------
+*/
+static void HTInflate_put_character(HTStream* me, char c) {
+	HTInflate_write(me, &c, 1);
+}
+
+
+/*	String handling
+**	---------------
+*/
+static void HTInflate_put_string(HTStream* me, const char* s) {
+	HTInflate_write(me, s, (int) strlen(s));
+}
+
+
+/*	Free an Inflate object
+**	----------------------
+*/
+static void HTInflate_free(HTStream* me) {
+	if(!me->finished && !me->failed && TRACE) {
+		fprintf(stderr, "HTInflate: Compressed data ended early\n");
+	}
+	inflateEnd(&me->z);
+	release(me);
+	(*me->targetClass.free)(me->sink);    /* ripple through */
+	free(me);
+}
+
+static void HTInflate_abort(HTStream* me, HTError e) {
+	inflateEnd(&me->z);
+	release(me);
+	(*me->targetClass.abort)(me->sink, e);
+	free(me);
+}
+
+
+/*	Inflate Object Class
+**	--------------------
+*/
+static const HTStreamClass HTInflateClass = {
+		"Inflate", HTInflate_free, HTInflate_abort, HTInflate_put_character,
+		HTInflate_put_string, HTInflate_write, NULL };
+
+
+/*	Creation method
+**	---------------
+*/
+HTStream* HTInflate(HTEncoding encoding, HTStream* sink) {
+	HTStream* me;
+
+	if(!HTCanInflate(encoding)) return sink;
+
+	me = malloc(sizeof(*me));
+	if(me == NULL) HTOOM(__FILE__, "HTInflate");
+	me->isa = &HTInflateClass;
+
+	me->sink = sink;
+	me->targetClass = *sink->isa;    /* Copy pointers to routines for speed */
+	me->raw = HT_FALSE;
+	me->started = HT_FALSE;
+	me->finished = HT_FALSE;
+	me->failed = HT_FALSE;
+	me->held = 0;
+	me->held_length = me->held_size = 0;
+
+	memset(&me->z, 0, sizeof(me->z));
+	/* 32 added to the window bits means accept both zlib and gzip headers */
+	if(inflateInit2(&me->z, MAX_WBITS + 32) != Z_OK) {
+		if(TRACE) fprintf(stderr, "HTInflate: inflateInit2 failed\n");
+		free(me);
+		return sink;
+	}
+
+	if(TRACE) {
+		fprintf(
+				stderr, "HTInflate: Decoding %s content\n",
+				HTAtom_name(encoding));
+	}
+	return me;
+}
+
+#else /* GOT_ZLIB */
+
+const char* HTAcceptEncodings = 0;
+
+HTBool HTCanInflate(HTEncoding encoding) {
+	(void) encoding;
+
+	return HT_FALSE;
+}
+
+HTStream* HTInflate(HTEncoding encoding, HTStream* sink) {
+	(void) encoding;
+
+	return sink;
+}
+
+#endif /* GOT_ZLIB */
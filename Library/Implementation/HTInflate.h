@@ -0,0 +1,54 @@
+/*                                                    Content-Encoding decoder for libwww
+                                 INFLATE STREAM
+
+   This stream undoes a gzip or deflate Content-Encoding, passing the decoded body on to
+   its sink in large blocks. It is inserted by HTStreamStack when the anchor being loaded
+   has been marked with one of these encodings (for example by the MIME parser).
+
+   Decoding needs the zlib library. Compile with GOT_ZLIB if it is linked in; otherwise
+   no encodings are accepted and the data is passed through untouched.
+
+ */
+#ifndef HTINFLATE_H
+#define HTINFLATE_H
+
+#include <HTStream.h>
+#include <HTFormat.h>
+
+/*
+
+HTCanInflate: Is this encoding one we can decode?
+
+ */
+HTBool HTCanInflate(HTEncoding encoding);
+
+/*
+
+HTInflate: Create a decoding stream
+
+  ON ENTRY,
+
+  encoding                is the Content-Encoding of the data to be fed in
+
+  sink                    is the stream which will receive the decoded data
+
+  ON EXIT,
+
+  returns                 a stream into which the encoded data should be fed, or the sink
+                         itself if the encoding can't be decoded.
+
+ */
+HTStream* HTInflate(HTEncoding encoding, HTStream* sink);
+
+/*
+
+   The value of the Accept-Encoding header we can send, or 0 if none.
+
+ */
+extern const char* HTAcceptEncodings;
+
+#endif /* HTINFLATE_H */
+
+/*
+
+   end of HTInflate.h */
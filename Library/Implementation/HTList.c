@@ -1,37 +1,111 @@
 /*	A small List class					      HTList.c
 **	==================
 **
-**	A list is represented as a sequence of linked nodes of type HTList.
-**	The first node is a header which contains no object.
-**	New nodes are inserted between the header and the rest of the list.
+**	A list is a header cell followed by cells of type HTList, each
+**	holding one object and pointing at the cell added before it.
+**	The cells live in blocks of FIRST_BLOCK, 2*FIRST_BLOCK, 4*FIRST_BLOCK
+**	... cells which are never moved, so the next pointers stay good
+**	while the list grows. The cell for the object added i'th (from 0)
+**	is found by arithmetic, which gives constant time counting and
+**	indexing. The header's object points at the block table.
+**
+**	The first block is part of the header allocation and the table of
+**	further blocks is only made when it is needed, since most lists
+**	(an anchor's children and sources, say) stay short.
 */
 
 #include <HTList.h>
 #include <HTSTD.h>
 
+#define FIRST_BLOCK 4
+#define MAX_BLOCKS 30        /* Enough for any int count */
+
+typedef struct _HTListBlocks {
+	int count;
+	HTList** block;        /* MAX_BLOCKS of them, once past the first */
+	HTList first[FIRST_BLOCK];
+} HTListBlocks;
+
+typedef struct _HTListHeader {    /* One allocation for the whole header */
+	HTList cell;
+	HTListBlocks blocks;
+} HTListHeader;
+
+#define BLOCKS(me) ((HTListBlocks*) (me)->object)
+
+
+/*	Find the cell for the i'th object added, allocating it if need be
+*/
+static HTList* cell_at(HTListBlocks* blocks, int i) {
+	int k = 0;
+	int first = 0;
+	int size = FIRST_BLOCK;
+
+	while(i >= first + size) {
+		first += size;
+		size *= 2;
+		k++;
+	}
+	if(k == 0) return &blocks->first[i];
+	if(!blocks->block) {
+		blocks->block = calloc(MAX_BLOCKS, sizeof(HTList*));
+		if(blocks->block == NULL) HTOOM(__FILE__, "HTList_addObject");
+	}
+	if(!blocks->block[k]) {
+		blocks->block[k] = malloc(size * sizeof(HTList));
+		if(blocks->block[k] == NULL) HTOOM(__FILE__, "HTList_addObject");
+	}
+	return &blocks->block[k][i - first];
+}
+
+
+/*	Take out one cell, moving the objects of newer cells down one
+**	place, and let go of the newest cell.
+*/
+static void remove_cell(HTList* me, HTList* target) {
+	HTList* c;
+	void* carry = NULL;
+
+	for(c = me->next; c != target; c = c->next) {
+		void* here = c->object;
+		c->object = carry;
+		carry = here;
+	}
+	target->object = carry;
+
+	me->next = me->next->next;
+	BLOCKS(me)->count--;
+}
+
+
 HTList* HTList_new(void) {
-	HTList* newList = malloc(sizeof(HTList));
-	if(newList == NULL) HTOOM(__FILE__, "HTList_new");
-	newList->object = NULL;
-	newList->next = NULL;
-	return newList;
+	HTListHeader* header = malloc(sizeof(HTListHeader));
+	if(header == NULL) HTOOM(__FILE__, "HTList_new");
+	header->blocks.count = 0;
+	header->blocks.block = NULL;
+	header->cell.object = &header->blocks;
+	header->cell.next = NULL;
+	return &header->cell;
 }
 
 void HTList_delete(HTList* me) {
-	HTList* current;
-	while((current = me)) {
-		me = me->next;
-		free(current);
+	int k;
+
+	if(!me) return;
+	if(BLOCKS(me)->block) {
+		for(k = 1; k < MAX_BLOCKS; k++) free(BLOCKS(me)->block[k]);
+		free(BLOCKS(me)->block);
 	}
+	free(me);    /* The header cell is first in its HTListHeader */
 }
 
 void HTList_addObject(HTList* me, void* newObject) {
 	if(me) {
-		HTList* newNode = malloc(sizeof(HTList));
-		if(newNode == NULL) HTOOM(__FILE__, "HTList_addObject");
+		HTList* newNode = cell_at(BLOCKS(me), BLOCKS(me)->count);
 		newNode->object = newObject;
 		newNode->next = me->next;
 		me->next = newNode;
+		BLOCKS(me)->count++;
 	}
 	else if(TRACE) {
 		fprintf(
@@ -43,13 +117,10 @@ void HTList_addObject(HTList* me, void* newObject) {
 
 HTBool HTList_removeObject(HTList* me, void* oldObject) {
 	if(me) {
-		HTList* previous;
-		while(me->next) {
-			previous = me;
-			me = me->next;
-			if(me->object == oldObject) {
-				previous->next = me->next;
-				free(me);
+		HTList* c;
+		for(c = me->next; c; c = c->next) {
+			if(c->object == oldObject) {
+				remove_cell(me, c);
 				return HT_TRUE;  /* Success */
 			}
 		}
@@ -59,10 +130,9 @@ HTBool HTList_removeObject(HTList* me, void* oldObject) {
 
 void* HTList_removeLastObject(HTList* me) {
 	if(me && me->next) {
-		HTList* lastNode = me->next;
-		void* lastObject = lastNode->object;
-		me->next = lastNode->next;
-		free(lastNode);
+		void* lastObject = me->next->object;
+		me->next = me->next->next;
+		BLOCKS(me)->count--;
 		return lastObject;
 	}
 	else {  /* Empty list */
@@ -72,15 +142,9 @@ void* HTList_removeLastObject(HTList* me) {
 
 void* HTList_removeFirstObject(HTList* me) {
 	if(me && me->next) {
-		HTList* prevNode = 0;
-		void* firstObject;
-		while(me->next) {
-			prevNode = me;
-			me = me->next;
-		}
-		firstObject = me->object;
-		prevNode->next = NULL;
-		free(me);
+		HTList* first = cell_at(BLOCKS(me), 0);
+		void* firstObject = first->object;
+		remove_cell(me, first);
 		return firstObject;
 	}
 	else {  /* Empty list */
@@ -89,12 +153,7 @@ void* HTList_removeFirstObject(HTList* me) {
 }
 
 int HTList_count(HTList* me) {
-	int count = 0;
-	if(me) {
-		while((me = me->next))
-			count++;
-	}
-	return count;
+	return me ? BLOCKS(me)->count : 0;
 }
 
 int HTList_indexOf(HTList* me, void* object) {
@@ -111,16 +170,8 @@ int HTList_indexOf(HTList* me, void* object) {
 }
 
 void* HTList_objectAt(HTList* me, int position) {
-	if(position < 0) {
-		return 0;
-	}
-	if(me) {
-		while((me = me->next)) {
-			if(position == 0) {
-				return me->object;
-			}
-			position--;
-		}
+	if(!me || position < 0 || position >= BLOCKS(me)->count) {
+		return 0;  /* Off the end of the list */
 	}
-	return 0;  /* Reached the end of the list */
+	return cell_at(BLOCKS(me), BLOCKS(me)->count - 1 - position)->object;
 }
@@ -4,6 +4,12 @@
 **
 **      The list object is a generic container for storing collections
 **      of things in order.
+**
+**      The objects are held in arrays, so that HTList_count and
+**      HTList_objectAt take constant time and adding an object never
+**      copies the ones already there. Position 0 is the object added
+**      most recently, which is also the first one HTList_nextObject
+**      returns.
 */
 #ifndef HTLIST_H
 #define HTLIST_H
@@ -12,6 +18,10 @@
 
 typedef struct _HTList HTList;
 
+/*      Each object is in a cell which points at the one added before it,
+**      so that the list can be walked with HTList_nextObject. The list
+**      itself is a header cell whose next is the newest cell.
+*/
 struct _HTList {
 	void* object;
 	HTList* next;
@@ -46,7 +56,8 @@ void* HTList_objectAt(HTList* me, int position);
 
 /* Fast macro to traverse the list. Call it first with copy of list header :
    it returns the first object and increments the passed list pointer.
-   Call it with the same variable until it returns NULL. */
+   Call it with the same variable until it returns NULL.
+   Don't add objects to a list while traversing it. */
 #define HTList_nextObject(me) \
   (me && (me = me->next) ? me->object : NULL)
 
@@ -22,7 +22,10 @@
 typedef enum _MIME_state {
 	MIME_TRANSPARENT,    /* put straight through to target ASAP! */
 	BEGINNING_OF_LINE,
+	CONTENT_,
 	CONTENT_T,
+	CONTENT_ENCODING,
+	CONTENT_LENGTH,
 	CONTENT_TRANSFER_ENCODING,
 	CONTENT_TYPE,
 	SKIP_GET_VALUE,        /* Skip space then get value */
@@ -55,6 +58,8 @@ struct _HTStream {
 	char* boundary;    /* For multipart */
 
 	HTFormat encoding;    /* Content-Transfer-Encoding */
+	HTEncoding content_encoding;    /* Content-Encoding */
+	long content_length;    /* Content-Length, 0 if not given */
 	HTFormat format;        /* Content-Type */
 	HTStream* target;        /* While writing out */
 	HTStreamClass targetClass;
@@ -116,8 +121,8 @@ static void HTMIME_put_character(HTStream* me, char c) {
 		case BEGINNING_OF_LINE:
 			switch(c) {
 				case 'c':
-				case 'C': me->check_pointer = "ontent-t";
-					me->if_ok = CONTENT_T;
+				case 'C': me->check_pointer = "ontent-";
+					me->if_ok = CONTENT_;
 					me->state = CHECK;
 					break;
 				case '\n':            /* Blank line: End of Header! */
@@ -129,6 +134,10 @@ static void HTMIME_put_character(HTStream* me, char c) {
 								HTAtom_name(me->format),
 								HTAtom_name(me->targetRep));
 					}
+					/* HTStreamStack puts in a decoder if one is needed */
+					HTAnchor_setContentEncoding(
+							me->anchor, me->content_encoding);
+					HTAnchor_setLength(me->anchor, me->content_length);
 					me->target = HTStreamStack(
 							me->format, me->targetRep, me->sink, me->anchor);
 					if(!me->target) {
@@ -171,6 +180,29 @@ static void HTMIME_put_character(HTStream* me, char c) {
 			}
 			break;
 
+		case CONTENT_:
+			switch(c) {
+				case 't':
+				case 'T': me->state = CONTENT_T;
+					break;
+
+				case 'e':
+				case 'E': me->check_pointer = "ncoding:";
+					me->if_ok = CONTENT_ENCODING;
+					me->state = CHECK;
+					break;
+
+				case 'l':
+				case 'L': me->check_pointer = "ength:";
+					me->if_ok = CONTENT_LENGTH;
+					me->state = CHECK;
+					break;
+
+				default: goto bad_field_name;
+
+			} /* switch on character */
+			break;
+
 		case CONTENT_T:
 			switch(c) {
 				case 'r':
@@ -192,6 +224,8 @@ static void HTMIME_put_character(HTStream* me, char c) {
 
 		case CONTENT_TYPE:
 		case CONTENT_TRANSFER_ENCODING:
+		case CONTENT_ENCODING:
+		case CONTENT_LENGTH:
 			me->field = me->state;        /* remember it */
 			me->state = SKIP_GET_VALUE;
 			/* Fall through! */
@@ -210,13 +244,24 @@ static void HTMIME_put_character(HTStream* me, char c) {
 		/* FALLTHROUGH */
 		case GET_VALUE:
 			if(HT_WHITE(c)) {            /* End of field */
+				size_t length = me->value_pointer - me->value;
 				*me->value_pointer = 0;
 				switch(me->field) {
-					case CONTENT_TYPE: me->format = HTAtom_for(me->value);
+					case CONTENT_TYPE:
+						me->format = HTAtom_forLen(me->value, length);
 						break;
 					case CONTENT_TRANSFER_ENCODING:
-						me->encoding = HTAtom_for(
-								me->value);
+						me->encoding = HTAtom_forLen(me->value, length);
+						break;
+					case CONTENT_ENCODING: {
+						char* p;
+						for(p = me->value; *p; p++) *p = (char) tolower(*p);
+						me->content_encoding = HTAtom_forLen(me->value, length);
+					}
+						break;
+					case CONTENT_LENGTH:
+						me->content_length = atol(me->value);
+						if(me->content_length < 0) me->content_length = 0;
 						break;
 					default:        /* Should never get here */
 						break;
@@ -308,7 +353,7 @@ static void HTMIME_abort(HTStream* me, HTError e) {
 */
 static const HTStreamClass HTMIME = {
 		"MIMEParser", HTMIME_free, HTMIME_abort, HTMIME_put_character,
-		HTMIME_put_string, HTMIME_write };
+		HTMIME_put_string, HTMIME_write, NULL };
 
 
 /*	Subclass-specific Methods
@@ -330,6 +375,8 @@ HTMIMEConvert(HTPresentation* pres, HTParentAnchor* anchor, HTStream* sink) {
 	me->format = WWW_PLAINTEXT;
 	me->targetRep = pres->rep_out;
 	me->boundary = 0;        /* Not set yet */
+	me->content_encoding = NULL;    /* Identity unless told otherwise */
+	me->content_length = 0;        /* Not known unless told */
 	me->net_ascii = HT_FALSE;    /* Local character set */
 	return me;
 }
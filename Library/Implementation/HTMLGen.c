@@ -24,6 +24,9 @@
 #define PUTC(c) (*me->targetClass.put_character)(me->target, c)
 #define PUTS(s) (*me->targetClass.put_string)(me->target, s)
 #define PUTB(s, l) (*me->targetClass.put_block)(me->target, s, l)
+#define PUTV(v, n) HTPutIovec(me->target, v, n)
+
+#define MAX_PIECES 32    /* Blocks handed down at once for one tag */
 
 /*		HTML Object
 **		-----------
@@ -62,31 +65,57 @@ static void HTMLGen_write(HTStructured* me, const char* s, unsigned l) {
 }
 
 
+/*	Add a piece of markup to the list
+**	---------------------------------
+**
+**	The list is sent on when full, so tags with many attributes still work.
+*/
+static void add_piece(
+		HTStructured* me, HTIovec* iov, int* count, const char* s, int l) {
+	if(*count == MAX_PIECES) {
+		PUTV(iov, *count);
+		*count = 0;
+	}
+	iov[*count].base = s;
+	iov[*count].len = l;
+	(*count)++;
+}
+
+#define PIECE(s) add_piece(me, iov, &count, s, (int) strlen(s))
+#define LITERAL(s) add_piece(me, iov, &count, s, (int) sizeof(s) - 1)
+
+
 /*	Start Element
 **	-------------
+**
+**	The whole tag goes down as one list of blocks, rather than a call
+**	on the target for each name, quote and bracket.
 */
 static void HTMLGen_start_element(
 		HTStructured* me, int element_number, const HTBool* present,
 		const char** value) {
+	HTIovec iov[MAX_PIECES];
+	int count = 0;
 	int i;
 
 	HTTag* tag = &HTML_dtd.tags[element_number];
-	PUTC('<');
-	PUTS(tag->name);
+	LITERAL("<");
+	PIECE(tag->name);
 	if(present) {
 		for(i = 0; i < tag->number_of_attributes; i++) {
 			if(present[i]) {
-				PUTC(' ');
-				PUTS(tag->attributes[i].name);
+				LITERAL(" ");
+				PIECE(tag->attributes[i].name);
 				if(value[i]) {
-					PUTS("=\"");
-					PUTS(value[i]);
-					PUTC('"');
+					LITERAL("=\"");
+					PIECE(value[i]);
+					LITERAL("\"");
 				}
 			}
 		}
 	}
-	PUTC('>');
+	LITERAL(">");
+	PUTV(iov, count);
 }
 
 
@@ -102,9 +131,13 @@ static void HTMLGen_start_element(
 **	TBL 921119
 */
 static void HTMLGen_end_element(HTStructured* me, int element_number) {
-	PUTS("</");
-	PUTS(HTML_dtd.tags[element_number].name);
-	PUTC('>');
+	HTIovec iov[3];
+	int count = 0;
+
+	LITERAL("</");
+	PIECE(HTML_dtd.tags[element_number].name);
+	LITERAL(">");
+	PUTV(iov, count);
 }
 
 
@@ -114,9 +147,13 @@ static void HTMLGen_end_element(HTStructured* me, int element_number) {
 */
 
 static void HTMLGen_put_entity(HTStructured* me, int entity_number) {
-	PUTC('&');
-	PUTS(HTML_dtd.entity_names[entity_number]);
-	PUTC(';');
+	HTIovec iov[3];
+	int count = 0;
+
+	LITERAL("&");
+	PIECE(HTML_dtd.entity_names[entity_number]);
+	LITERAL(";");
+	PUTV(iov, count);
 }
 
 
@@ -177,6 +214,8 @@ HTStructured* HTMLGenerator(HTStream* output) {
 **	This object just converts a plain text stream into HTML
 **	It is officially a structured strem but only the stream bits exist.
 **	This is just the easiest way of typecasting all the routines.
+**	The structured methods must stay NULL: the first of them sits where
+**	an HTStreamClass keeps put_iovec.
 */
 static const HTStructuredClass PlainToHTMLConversion = {
 		"plaintexttoHTML", HTMLGen_free, PlainToHTML_abort,
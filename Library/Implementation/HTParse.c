@@ -4,20 +4,11 @@
 
 #include <HTUtils.h>
 #include <HTParse.h>
+#include <HTString.h>
 #include <HTSTD.h>
 
 #define HEX_ESCAPE '%'
 
-struct struct_parts {
-	char* access;
-	char* host;
-	char* absolute;
-	char* relative;
-/*	char * search;		no - treated as part of path */
-	char* anchor;
-};
-
-
 /*	Strip white space off a string
 **	------------------------------
 **
@@ -41,215 +32,362 @@ char* HTStrip(char* s) {
 }
 
 
-/*	Scan a filename for its consituents
-**	-----------------------------------
+/*	Scan a name for its constituents
+**	--------------------------------
 **
-** On entry,
-**	name	points to a document name which may be incomplete.
-** On exit,
-**      absolute or relative may be nonzero (but not both).
-**	host, anchor and access may be nonzero if they were specified.
-**	Any which are nonzero point to zero terminated strings.
+**	One pass over the name, which is not changed and nothing is
+**	allocated. Each part is given as an offset and length in name.
+**
+**	The access is what comes before the first ':' if that is before
+**	any '/' or '#'. A host follows "//" up to the next '/', and path
+**	is everything after it up to the anchor, from its '/' if there is
+**	one. The anchor runs from the first '#' to any second one, except
+**	in names with an access but no host such as news:j462#36487@foo.bar,
+**	where the '#' is part of the path -- JFG 10/7/92, from bug report.
 */
-static void scan(char* name, struct struct_parts* parts) {
-	char* after_access;
-	char* p;
-	int length = (int) strlen(name);
-
-	parts->access = 0;
-	parts->host = 0;
-	parts->absolute = 0;
-	parts->relative = 0;
-	parts->anchor = 0;
-
-	after_access = name;
-	for(p = name; *p; p++) {
+#define SPAN(span, from, to) \
+	((span).start = (int) ((from) - name), (span).length = (int) ((to) - (from)))
+#define NO_SPAN(span) ((span).start = -1, (span).length = 0)
+
+void HTParseSpans(const char* name, HTURLSpans* spans) {
+	const char* p;
+	const char* after_access = name;
+	const char* hash;
+	const char* end;
+
+	NO_SPAN(spans->access);
+	NO_SPAN(spans->host);
+	NO_SPAN(spans->port);
+	NO_SPAN(spans->path);
+	NO_SPAN(spans->query);
+	NO_SPAN(spans->anchor);
+
+	for(p = name; *p && *p != '/' && *p != '#'; p++) {
 		if(*p == ':') {
-			*p = 0;
-			parts->access = name;    /* Access name has been specified */
+			SPAN(spans->access, name, p);
 			after_access = p + 1;
+			break;
 		}
-		if(*p == '/') break;
-		if(*p == '#') break;
 	}
 
-	for(p = name + length - 1; p >= name; p--) {
-		if(*p == '#') {
-			parts->anchor = p + 1;
-			*p = 0;                /* terminate the rest */
-		}
-	}
+	hash = strchr(after_access, '#');
+	end = hash ? hash : after_access + strlen(after_access);
+
 	p = after_access;
-	if(*p == '/') {
-		if(p[1] == '/') {
-			parts->host = p + 2;        /* host has been specified 	*/
-			*p = 0;            /* Terminate access 		*/
-			p = strchr(
-					parts->host, '/');    /* look for end of host name if any */
-			if(p) {
-				*p = 0;            /* Terminate host */
-				parts->absolute = p + 1;        /* Root has been found */
-			}
-		}
-		else {
-			parts->absolute = p + 1;        /* Root found but no host */
-		}
+	if(p[0] == '/' && p[1] == '/') {
+		const char* slash;
+		const char* colon;
+
+		p += 2;
+		for(slash = p; slash < end && *slash != '/'; slash++);
+		SPAN(spans->host, p, slash);
+		for(colon = p; colon < slash && *colon != ':'; colon++);
+		if(colon < slash) SPAN(spans->port, colon + 1, slash);
+		p = slash;
 	}
-	else {
-		parts->relative = (*after_access) ? after_access
-										  : 0;    /* zero for "" */
+	else if(hash && spans->access.start >= 0) {    /* '#' is not an anchor */
+		hash = 0;
+		end = after_access + strlen(after_access);
 	}
 
-	/* Access specified but no host: the anchor was not really one
-	   e.g. news:j462#36487@foo.bar -- JFG 10/7/92, from bug report */
-	if(parts->access && !parts->host && parts->anchor) {
-		*(parts->anchor - 1) = '#';  /* Restore the '#' in the address */
-		parts->anchor = 0;
+	if(p < end) SPAN(spans->path, p, end);
+	if(hash) {    /* Up to any second '#' */
+		const char* q = strchr(hash + 1, '#');
+		SPAN(spans->anchor, hash + 1, q ? q : hash + 1 + strlen(hash + 1));
 	}
 
-#ifdef NOT_DEFINED    /* search is just treated as part of path */
-	{
-		char *p = relative ? relative : absolute;
-	if (p) {
-		char * q = strchr(p, '?');	/* Any search string? */
-		if (q) {
-			*q = 0;			/* If so, chop that off. */
-		parts->search = q+1;
-		}
+	if(spans->path.start >= 0) {
+		const char* q = memchr(p, '?', end - p);
+		if(q) SPAN(spans->query, q + 1, end);
 	}
-	}
-#endif
-} /*scan */
+}
 
 
-/*	Parse a Name relative to another name
-**	-------------------------------------
+/*	Output to a buffer which may be too small
+**	-----------------------------------------
 **
-**	This returns those parts of a name which are given (and requested)
-**	substituting bits from the related name where necessary.
+**	Everything is counted, but only what fits is written. Once something
+**	hasn't fit, the longest the output has been is a length which will.
+*/
+typedef struct {
+	char* buffer;
+	int size;
+	int length;
+	int longest;
+	HTBool full;
+} HTParseOutput;
+
+static void put(HTParseOutput* out, const char* s, int length) {
+	if(out->length + length < out->size) {
+		memcpy(out->buffer + out->length, s, length);
+	}
+	else {
+		out->full = HT_TRUE;
+	}
+	out->length += length;
+	if(out->length > out->longest) out->longest = out->length;
+}
+
+#define PUT_SPAN(out, name, span) \
+	put((out), (name) + (span).start, (span).length)
+
+static HTBool same_span(
+		const char* a, HTSpan sa, const char* b, HTSpan sb) {
+	return sa.length == sb.length &&
+		   0 == strncmp(a + sa.start, b + sb.start, sa.length);
+}
+
+
+/*	Default ports
+**	-------------
 **
-** On entry,
-**	aName		A filename given
-**      relatedName     A name relative to which aName is to be parsed
-**      wanted          A mask for the bits which are wanted.
+**	One for each access with a protocol module, and https. They are here
+**	rather than in the HTProtocols as protocols are only registered when
+**	first loading, and a canonical address must not change after that.
+*/
+static const struct {
+	const char* access;
+	const char* port;
+} default_ports[] = {
+		{"http",   "80"},
+		{"https",  "443"},
+		{"gopher", "70"},
+		{"ftp",    "21"},
+		{"news",   "119"},
+		{"nntp",   "119"},
+		{"telnet", "23"},
+		{"tn3270", "23"},
+		{"rlogin", "513"},
+		{"wais",   "210"},
+		{0,        0}};
+
+static HTBool is_default_port(
+		const char* access, int access_length, const char* port,
+		int port_length) {
+	int i;
+
+	if(!access) return HT_FALSE;
+	for(i = 0; default_ports[i].access; i++) {
+		if((int) strlen(default_ports[i].access) == access_length &&
+		   0 == strncasecomp(access, default_ports[i].access, access_length)) {
+			return (int) strlen(default_ports[i].port) == port_length &&
+				   0 == strncmp(port, default_ports[i].port, port_length);
+		}
+	}
+	return HT_FALSE;
+}
+
+
+/*	Put out a host name, tidied
+**	---------------------------
 **
-** On exit,
-**	returns		A pointer to a malloc'd string which MUST BE FREED
+**	Default port numbers, empty ports and trailing dots on FQDNs are
+**	left out, as they only cause identical addresses to look different.
 */
-char* HTParse(const char* aName, const char* relatedName, int wanted) {
-	char* result = 0;
-	char* return_value = 0;
-	int len;
-	char* name = 0;
-	char* rel = 0;
-	char* p;
-	char* access;
-	struct struct_parts given, related;
-
-	/* Make working copies of input strings to cut up:
-	*/
-	len = (int) (strlen(aName) + strlen(relatedName) + 10);
-	result = malloc(len);        /* Lots of space: more than enough */
-	if(result == NULL) HTOOM(__FILE__, "HTParse");
+static void put_host(
+		HTParseOutput* out, const char* name, const HTURLSpans* spans,
+		const char* access, int access_length) {
+	int length = spans->port.start >= 0 ?
+				 spans->port.start - 1 - spans->host.start :
+				 spans->host.length;
+	const char* port = name + spans->port.start;
+
+	if(length > 0 && name[spans->host.start + length - 1] == '.') {
+		put(out, name + spans->host.start, length - 1);
+	}
+	else {
+		put(out, name + spans->host.start, length);
+	}
+	if(spans->port.length > 0 &&
+	   !is_default_port(access, access_length, port, spans->port.length)) {
+		put(out, port - 1, spans->port.length + 1);
+	}
+}
 
-	StrAllocCopy(name, aName);
-	StrAllocCopy(rel, relatedName);
 
-	scan(name, &given);
-	scan(rel, &related);
-	result[0] = 0;        /* Clear string  */
-	access = given.access ? given.access : related.access;
+/*	Put together a name from the parts of two
+**	-----------------------------------------
+**
+**	This gives those parts of a name which are given (and requested)
+**	substituting bits from the related name where necessary. The
+**	related spans are a copy, as parts of them are dropped.
+*/
+static int resolve(
+		const char* aName, const HTURLSpans* given_spans,
+		const char* relatedName, HTURLSpans related, int wanted,
+		char* buffer, int size) {
+	HTURLSpans given;
+	HTParseOutput out;
+	const char* access = 0;
+	int access_length = 0;
+
+	given = *given_spans;
+	out.buffer = buffer;
+	out.size = size;
+	out.length = 0;
+	out.longest = 0;
+	out.full = HT_FALSE;
+
+	if(given.access.start >= 0) {
+		access = aName + given.access.start;
+		access_length = given.access.length;
+	}
+	else if(related.access.start >= 0) {
+		access = relatedName + related.access.start;
+		access_length = related.access.length;
+	}
 	if(wanted & HT_PARSE_ACCESS) {
 		if(access) {
-			strcat(result, access);
-			if(wanted & HT_PARSE_PUNCTUATION) strcat(result, ":");
+			put(&out, access, access_length);
+			if(wanted & HT_PARSE_PUNCTUATION) put(&out, ":", 1);
 		}
 	}
 
-	if(given.access && related.access) {    /* If different, inherit nothing. */
-		if(strcmp(given.access, related.access) != 0) {
-			related.host = 0;
-			related.absolute = 0;
-			related.relative = 0;
-			related.anchor = 0;
+	if(given.access.start >= 0 && related.access.start >= 0) {
+		/* If different, inherit nothing. */
+		if(!same_span(aName, given.access, relatedName, related.access)) {
+			NO_SPAN(related.host);
+			NO_SPAN(related.path);
+			NO_SPAN(related.anchor);
 		}
 	}
 
 	if(wanted & HT_PARSE_HOST) {
-		if(given.host || related.host) {
-			char* tail = result + strlen(result);
-			if(wanted & HT_PARSE_PUNCTUATION) strcat(result, "//");
-			strcat(result, given.host ? given.host : related.host);
-#define CLEAN_URLS
-#ifdef CLEAN_URLS
-			/* Ignore default port numbers, and trailing dots on FQDNs
-			   which will only cause identical adreesses to look different */
-			{
-				char* v;
-				v = strchr(tail, ':');
-				if(v && access) {        /* Port specified */
-					if((strcmp(access, "http") == 0 && strcmp(v, ":80") == 0) ||
-					   (strcmp(access, "gopher") == 0 &&
-						strcmp(v, ":70") == 0)) {
-						*v = (char) 0;
-					}    /* It is the default: ignore it */
-				}
-				if(!v) v = tail + strlen(tail); /* After hostname */
-				v--;                /* End of hostname */
-				if(*v == '.') *v = (char) 0; /* chop final . */
-			}
-#endif
+		if(given.host.start >= 0) {
+			if(wanted & HT_PARSE_PUNCTUATION) put(&out, "//", 2);
+			put_host(&out, aName, &given, access, access_length);
+		}
+		else if(related.host.start >= 0) {
+			if(wanted & HT_PARSE_PUNCTUATION) put(&out, "//", 2);
+			put_host(&out, relatedName, &related, access, access_length);
 		}
 	}
 
-	if(given.host && related.host) {  /* If different hosts, inherit no path. */
-		if(strcmp(given.host, related.host) != 0) {
-			related.absolute = 0;
-			related.relative = 0;
-			related.anchor = 0;
+	if(given.host.start >= 0 && related.host.start >= 0) {
+		/* If different hosts, inherit no path. */
+		if(!same_span(aName, given.host, relatedName, related.host)) {
+			NO_SPAN(related.path);
+			NO_SPAN(related.anchor);
 		}
 	}
 
 	if(wanted & HT_PARSE_PATH) {
-		if(given.absolute) {                /* All is given */
-			if(wanted & HT_PARSE_PUNCTUATION) strcat(result, "/");
-			strcat(result, given.absolute);
+		HTBool given_absolute = given.path.start >= 0 &&
+								aName[given.path.start] == '/';
+		HTBool related_absolute = related.path.start >= 0 &&
+								  relatedName[related.path.start] == '/';
+
+		if(given_absolute) {                /* All is given */
+			if(wanted & HT_PARSE_PUNCTUATION) put(&out, "/", 1);
+			put(&out, aName + given.path.start + 1, given.path.length - 1);
 		}
-		else if(related.absolute) {    /* Adopt path not name */
-			strcat(result, "/");
-			strcat(result, related.absolute);
-			if(given.relative) {
-				p = strchr(result, '?');    /* Search part? */
-				if(!p) p = result + strlen(result) - 1;
-				for(; *p != '/'; p--);    /* last / */
-				p[1] = 0;                    /* Remove filename */
-				strcat(result, given.relative);        /* Add given one */
-				HTSimplify(result);
+		else if(related_absolute) {    /* Adopt path not name */
+			int path = out.length;
+			PUT_SPAN(&out, relatedName, related.path);
+			if(given.path.start >= 0) {
+				const char* r = relatedName + related.path.start;
+				int cut = related.query.start >= 0 ?    /* Search part? */
+						  related.query.start - 1 - related.path.start :
+						  related.path.length - 1;
+
+				while(r[cut] != '/') cut--;    /* last / */
+				out.length = path + cut + 1;    /* Remove filename */
+				PUT_SPAN(&out, aName, given.path);    /* Add given one */
+				if(!out.full) {
+					out.buffer[out.length] = 0;
+					HTSimplify(out.buffer);
+					out.length = (int) strlen(out.buffer);
+				}
 			}
 		}
-		else if(given.relative) {
-			strcat(result, given.relative);        /* what we've got */
+		else if(given.path.start >= 0) {
+			PUT_SPAN(&out, aName, given.path);    /* what we've got */
 		}
-		else if(related.relative) {
-			strcat(result, related.relative);
+		else if(related.path.start >= 0) {
+			PUT_SPAN(&out, relatedName, related.path);
 		}
 		else {  /* No inheritance */
-			strcat(result, "/");
+			put(&out, "/", 1);
 		}
 	}
 
 	if(wanted & HT_PARSE_ANCHOR) {
-		if(given.anchor || related.anchor) {
-			if(wanted & HT_PARSE_PUNCTUATION) strcat(result, "#");
-			strcat(result, given.anchor ? given.anchor : related.anchor);
+		if(given.anchor.start >= 0 || related.anchor.start >= 0) {
+			if(wanted & HT_PARSE_PUNCTUATION) put(&out, "#", 1);
+			if(given.anchor.start >= 0) {
+				PUT_SPAN(&out, aName, given.anchor);
+			}
+			else {
+				PUT_SPAN(&out, relatedName, related.anchor);
+			}
 		}
 	}
-	free(rel);
-	free(name);
 
-	StrAllocCopy(return_value, result);
-	free(result);
-	return return_value;        /* exactly the right length */
+	if(out.full) return out.longest;
+	out.buffer[out.length] = 0;
+	return out.length;
+}
+
+
+/*	Parse a Name relative to another name into a buffer
+**	---------------------------------------------------
+**
+** On entry,
+**	aName		A filename given
+**      relatedName     A name relative to which aName is to be parsed
+**      wanted          A mask for the bits which are wanted.
+**	buffer, size	Where to put the result, with its terminating 0
+** On exit,
+**	returns		The length of the result. If that is size or more
+**			the result did not fit, and a buffer of more than
+**			the length returned will hold it.
+*/
+int HTParseInto(
+		const char* aName, const char* relatedName, int wanted, char* buffer,
+		int size) {
+	HTURLSpans given, related;
+
+	HTParseSpans(aName, &given);
+	HTParseSpans(relatedName, &related);
+	return resolve(
+			aName, &given, relatedName, related, wanted, buffer, size);
+}
+
+
+/*	Parse names relative to one base
+**	--------------------------------
+**
+**	The base is scanned once, for all the links in a document.
+*/
+void HTParseSetBase(HTParseBase* base, const char* name) {
+	base->name = name;
+	HTParseSpans(name, &base->spans);
+}
+
+int HTParseRelative(
+		const char* aName, const HTParseBase* base, int wanted, char* buffer,
+		int size) {
+	HTURLSpans given;
+
+	HTParseSpans(aName, &given);
+	return resolve(
+			aName, &given, base->name, base->spans, wanted, buffer, size);
+}
+
+
+/*	Parse a Name relative to another name
+**	-------------------------------------
+**
+**	As HTParseInto, but returns a malloc'd string which MUST BE FREED.
+**	The result can't be longer than both names together.
+*/
+char* HTParse(const char* aName, const char* relatedName, int wanted) {
+	int size = (int) (strlen(aName) + strlen(relatedName) + 10);
+	char* result = malloc(size);
+
+	if(result == NULL) HTOOM(__FILE__, "HTParse");
+	HTParseInto(aName, relatedName, wanted, result, size);
+	return result;
 }
 
 
@@ -269,33 +407,44 @@ char* HTParse(const char* aName, const char* relatedName, int wanted) {
 //	or	../../albert.html
 */
 void HTSimplify(char* filename) {
-	char* p;
-	char* q;
-	if(filename[0] && filename[1]) {    /* Bug fix 12 Mar 93 TBL */
-		for(p = filename + 2; *p; p++) {
-			if(*p == '/') {
-				if((p[1] == '.') && (p[2] == '.') && (p[3] == '/' || !p[3])) {
-					for(q = p - 1; (q >= filename) && (*q != '/');
-							q--) { } /* prev slash */
-					if(q[0] == '/' && 0 != strncmp(q, "/../", 4) &&
-					   !(q - 1 > filename && q[-1] == '/')) {
-						strcpy(q, p + 3);    /* Remove  /xxx/..	*/
-						if(!*filename) strcpy(filename, "/");
-						p = q - 1;        /* Start again with prev slash 	*/
-					}
-					else {            /*   xxx/.. leave it!	*/
-#ifdef BUG_CODE
-						strcpy(filename, p[3] ? p+4 : p+3); /* rm  xxx/../	*/
-						p = filename;		/* Start again */
-#endif
-					}
-				}
-				else if((p[1] == '.') && (p[2] == '/' || !p[2])) {
-					strcpy(p, p + 2);            /* Remove a slash and a dot */
-				}
+	char* p = filename;    /* Reading */
+	char* w = filename;    /* Writing: never ahead of p */
+	char* from = filename + 2;    /* Where a "/." or "/.." may start */
+
+	if(!filename[0] || !filename[1]) return;    /* Bug fix 12 Mar 93 TBL */
+	if(!strstr(filename, "/.")) return;    /* Nothing to remove */
+
+/*	One pass, copying down over what is removed. What has been written
+**	is itself the stack of segments kept: "/.." drops the one on top by
+**	moving w back to its slash. A segment is looked back over only when
+**	it is dropped or when a ".." which stays goes on top of it, so the
+**	whole is linear however many dots there are.
+**
+**	A slash in the first two places starts no "/." or "/.." unless
+**	something before it has been removed.
+*/
+	while(*p) {
+		if(*p == '/' && w >= from && p[1] == '.') {
+			if(p[2] == '.' && (p[3] == '/' || !p[3])) {
+				char* q = w;        /* Just after the prev slash */
+				while(q > filename && q[-1] != '/') q--;
+				if(q > filename && !(w - q == 2 && q[0] == '.' && q[1] == '.') &&
+				   !(q - 2 > filename && q[-2] == '/')) {
+					w = q - 1;            /* Remove  /xxx/..	*/
+					if(w < from) from = w;
+					p += 3;
+					continue;
+				}                    /*   xxx/.. leave it!	*/
+			}
+			else if(p[2] == '/' || !p[2]) {
+				p += 2;                /* Remove a slash and a dot */
+				continue;
 			}
 		}
+		*w++ = *p++;
 	}
+	*w = 0;
+	if(!*filename) strcpy(filename, "/");
 }
 
 
@@ -375,14 +524,21 @@ char* HTRelative(const char* aName, const char* relatedName) {
 **	Unlike HTUnEscape(), this routine returns a malloced string.
 */
 
-static const unsigned char isAcceptable[96] =
+static const unsigned char isAcceptable[256] =
 
 /*	Bit 0		xalpha		-- see HTFile.h
 **	Bit 1		xpalpha		-- as xalpha but with plus.
 **	Bit 3 ...	path		-- as xpalphas but with /
+**
+**	Nothing outside 2x to 7x is acceptable; the whole 256 are given
+**	so that a byte can index the table without a range check.
 */
 		/*   0 1 2 3 4 5 6 7 8 9 A B C D E F */
 		{
+				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+				0,    /* 0x */
+				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+				0,    /* 1x */
 				0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 7, 6, 0, 7, 7,
 				4,    /* 2x   !"#$%&'()*+,-./	 */
 				7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 0, 0, 0, 0, 0,
@@ -398,27 +554,87 @@ static const unsigned char isAcceptable[96] =
 
 static char* hex = "0123456789ABCDEF";
 
+#define ACCEPTABLE(a)    (isAcceptable[(unsigned char) (a)] & mask)
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+/*	Acceptable characters at the start of s, 16 at a time
+**
+**	Letters, digits and "*-.@_" are acceptable whatever the mask, and
+**	"+" and "/" as it says. Stops at the first block of 16 with any
+**	other byte in it, leaving that for the caller to go through.
+*/
+static size_t acceptable_blocks(
+		const char* s, size_t length, unsigned char mask) {
+	const __m128i below_lower = _mm_set1_epi8('a' - 1);
+	const __m128i above_lower = _mm_set1_epi8('z' + 1);
+	const __m128i below_digit = _mm_set1_epi8('0' - 1);
+	const __m128i above_digit = _mm_set1_epi8('9' + 1);
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+	const __m128i plus = _mm_set1_epi8(mask & (URL_XPALPHAS | URL_PATH) ? '+' : 0);
+	const __m128i slash = _mm_set1_epi8(mask & URL_PATH ? '/' : 0);
+	size_t i;
+
+	if(!(mask & (URL_XALPHAS | URL_XPALPHAS | URL_PATH))) return 0;
+	for(i = 0; i + 16 <= length; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*) (s + i));
+		__m128i folded = _mm_or_si128(v, case_bit);
+		__m128i ok = _mm_and_si128(
+				_mm_cmpgt_epi8(folded, below_lower),
+				_mm_cmplt_epi8(folded, above_lower));
+
+		ok = _mm_or_si128(ok, _mm_and_si128(
+				_mm_cmpgt_epi8(v, below_digit), _mm_cmplt_epi8(v, above_digit)));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('*')));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('@')));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, plus));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, slash));
+		if(_mm_movemask_epi8(ok) != 0xFFFF) break;
+	}
+	return i;
+}
+#else
+#define acceptable_blocks(s, length, mask) 0
+#endif
+
+/*	Length of the run of acceptable characters at the start of s
+*/
+static size_t acceptable_run(const char* s, size_t length, unsigned char mask) {
+	size_t i = acceptable_blocks(s, length, mask);
+
+	while(i < length && ACCEPTABLE(s[i])) i++;
+	return i;
+}
+
 char* HTEscape(const char* str, unsigned char mask) {
-#define ACCEPTABLE(a)    ( a>=32 && a<128 && ((isAcceptable[a-32]) & mask))
-	const char* p;
+	size_t length = strlen(str);
+	size_t unacceptable = 0;
+	size_t i;
 	char* q;
 	char* result;
-	int unacceptable = 0;
-	for(p = str; *p; p++) {
-		if(!ACCEPTABLE((unsigned char) (*p))) {
-			unacceptable++;
-		}
+
+	for(i = acceptable_run(str, length, mask); i < length;
+			i += 1 + acceptable_run(str + i + 1, length - i - 1, mask)) {
+		unacceptable++;
 	}
-	result = malloc(p - str + unacceptable + unacceptable + 1);
+	result = malloc(length + unacceptable + unacceptable + 1);
 	if(result == NULL) HTOOM(__FILE__, "HTEscape");
-	for(q = result, p = str; *p; p++) {
-		unsigned char a = (*p);
-		if(!ACCEPTABLE(a)) {
+
+	for(q = result, i = 0; i < length;) {
+		size_t run = acceptable_run(str + i, length - i, mask);
+		memcpy(q, str + i, run);
+		q += run;
+		i += run;
+		if(i < length) {
+			unsigned char a = str[i++];
 			*q++ = HEX_ESCAPE;    /* Means hex commming */
 			*q++ = hex[a >> 4];
 			*q++ = hex[a & 15];
 		}
-		else { *q++ = *p; }
 	}
 	*q++ = 0;            /* Terminate */
 	return result;
@@ -432,6 +648,11 @@ char* HTEscape(const char* str, unsigned char mask) {
 **	characters may have been encoded in %xy form, where xy is
 **	the acsii hex code for character 16x+y.
 **	The string is converted in place, as it will never grow.
+**
+**	The text between escapes is found with memchr and moved down
+**	whole, so a string with none is only read. Unlike HTEscape this
+**	looks for one character only, which is what memchr does, already
+**	vectorized by the C library, so there is no SSE2 path of our own.
 */
 
 static char from_hex(char c) {
@@ -441,18 +662,22 @@ static char from_hex(char c) {
 }
 
 char* HTUnEscape(char* str) {
-	char* p = str;
-	char* q = str;
-	while(*p) {
-		if(*p == HEX_ESCAPE) {
-			p++;
-			if(*p) *q = from_hex(*p++) * 16;
-			if(*p) *q = (*q + from_hex(*p++));
-			q++;
-		}
-		else {
-			*q++ = *p++;
-		}
+	char* end = str + strlen(str);
+	char* p = memchr(str, HEX_ESCAPE, end - str);
+	char* q = p;
+
+	if(!p) return str;
+	while(p) {
+		char* next;
+		p++;
+		if(*p) *q = from_hex(*p++) * 16;
+		if(*p) *q = (*q + from_hex(*p++));
+		q++;
+		next = memchr(p, HEX_ESCAPE, end - p);
+		if(!next) next = end;
+		memmove(q, p, next - p);
+		q += next - p;
+		p = next < end ? next : NULL;
 	}
 
 	*q++ = 0;
@@ -461,3 +686,164 @@ char* HTUnEscape(char* str) {
 } /* HTUnEscape */
 
 
+/*	Put out part of an address with its escapes tidied
+**	--------------------------------------------------
+**
+**	An escaped letter, digit or one of "-._~" means just the same as the
+**	character, so is unescaped. Other escapes are put in upper case.
+*/
+#define UNRESERVED(c) \
+	(((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || \
+	 ((c) >= '0' && (c) <= '9') || (c) == '-' || (c) == '.' || (c) == '_' || \
+	 (c) == '~')
+
+static void put_unescaped(HTParseOutput* out, const char* s, int length) {
+	const char* end = s + length;
+
+	while(s < end) {
+		const char* p = memchr(s, HEX_ESCAPE, end - s);
+		if(!p) p = end;
+		put(out, s, (int) (p - s));
+		if(p == end) break;
+		if(end - p >= 3 && isxdigit((unsigned char) p[1]) &&
+		   isxdigit((unsigned char) p[2])) {
+			char c = (char) (from_hex(p[1]) * 16 + from_hex(p[2]));
+			if(UNRESERVED(c)) {
+				put(out, &c, 1);
+			}
+			else {
+				char escape[3];
+				escape[0] = HEX_ESCAPE;
+				escape[1] = (char) toupper((unsigned char) p[1]);
+				escape[2] = (char) toupper((unsigned char) p[2]);
+				put(out, escape, 3);
+			}
+			s = p + 3;
+		}
+		else {
+			put(out, p, 1);    /* A stray '%' */
+			s = p + 1;
+		}
+	}
+}
+
+static void lower_case(HTParseOutput* out, int from) {
+	int i;
+
+	if(out->full) return;
+	for(i = from; i < out->length; i++) {
+		out->buffer[i] = (char) tolower((unsigned char) out->buffer[i]);
+	}
+}
+
+
+/*	Put an address in canonical form
+**	--------------------------------
+**
+**	Only the host after any "user@" goes into lower case. The path is
+**	simplified before the search part is added, as dots there mean
+**	nothing special; what follows '#' is kept as it is.
+*/
+int HTCanonicalInto(const char* address, char* buffer, int size) {
+	HTURLSpans spans;
+	HTParseOutput out;
+	const char* access = 0;
+	int access_length = 0;
+
+	out.buffer = buffer;
+	out.size = size;
+	out.length = 0;
+	out.longest = 0;
+	out.full = HT_FALSE;
+	HTParseSpans(address, &spans);
+
+	if(spans.access.start >= 0) {
+		access = address + spans.access.start;
+		access_length = spans.access.length;
+		put(&out, access, access_length);
+		lower_case(&out, 0);
+		put(&out, ":", 1);
+	}
+
+	if(spans.host.start >= 0) {
+		int host;
+		put(&out, "//", 2);
+		host = out.length;
+		put_host(&out, address, &spans, access, access_length);
+		if(!out.full) {
+			int at;
+			for(at = out.length - 1; at >= host && buffer[at] != '@'; at--);
+			lower_case(&out, at + 1);
+		}
+	}
+
+	if(spans.path.start >= 0) {
+		int path = out.length;
+		put_unescaped(&out, address + spans.path.start,
+				spans.query.start >= 0 ?
+				spans.query.start - 1 - spans.path.start : spans.path.length);
+		if(!out.full && buffer[path] == '/') {
+			buffer[out.length] = 0;
+			if(strstr(buffer + path, "/.")) {    /* Else nothing to do */
+				HTSimplify(buffer);
+				out.length = (int) strlen(buffer);
+			}
+		}
+		if(out.length == path && spans.host.start >= 0) put(&out, "/", 1);
+	}
+	else if(spans.host.start >= 0) {
+		put(&out, "/", 1);
+	}
+
+	if(spans.query.start >= 0) {
+		put(&out, "?", 1);
+		put_unescaped(&out, address + spans.query.start, spans.query.length);
+	}
+
+	if(spans.anchor.start >= 0) {
+		put(&out, "#", 1);
+		PUT_SPAN(&out, address, spans.anchor);
+	}
+
+	if(out.full) return out.longest;
+	buffer[out.length] = 0;
+	return out.length;
+}
+
+
+/*	64 bit FNV-1a
+**	-------------
+**
+**	Where a long has 64 bits it is used whole. Otherwise the multiply by
+**	2^40 + 0x1b3 is done in 16 bit pieces, so that nothing needs more
+**	than 32 bits.
+*/
+void HTFingerprintOf(const char* string, HTFingerprint* fingerprint) {
+#if ULONG_MAX >> 31 >> 31 >= 3
+	unsigned long hash = 0xcbf29ce4UL << 16 << 16 | 0x84222325UL;
+
+	for(; *string; string++) {
+		hash ^= (unsigned char) *string;
+		hash *= 1UL << 20 << 20 | 0x1b3UL;
+	}
+	fingerprint->high = (hash >> 16 >> 16) & 0xffffffffUL;
+	fingerprint->low = hash & 0xffffffffUL;
+#else
+	unsigned long high = 0xcbf29ce4UL;
+	unsigned long low = 0x84222325UL;
+
+	for(; *string; string++) {
+		unsigned long a, b, m;
+
+		low ^= (unsigned char) *string;
+		a = (low >> 16) * 0x1b3;
+		b = (low & 0xffff) * 0x1b3;
+		m = (b >> 16) + (a & 0xffff);
+		high = (high * 0x1b3 + (a >> 16) + (m >> 16) + (low << 8)) &
+			   0xffffffffUL;
+		low = ((m & 0xffff) << 16) | (b & 0xffff);
+	}
+	fingerprint->high = high;
+	fingerprint->low = low;
+#endif
+}
@@ -46,6 +46,105 @@ HTParse:  Parse a URL relative to another URL
 
 char* HTParse(const char* aName, const char* relatedName, int wanted);
 
+/*
+
+HTParseInto:  Parse a URL relative to another URL into a buffer
+
+   As HTParse, but nothing is allocated.
+   
+  ON ENTRY
+  
+  buffer, size            Where to put the result, with its terminating zero
+                         
+  ON EXIT,
+  
+  returns                 The length of the result. If this is size or more, the result
+                         did not fit and buffer holds nothing useful; a buffer of more
+                         than the length returned will do.
+                         
+ */
+
+int HTParseInto(
+		const char* aName, const char* relatedName, int wanted, char* buffer,
+		int size);
+
+/*
+
+HTParseSpans:  Find the parts of a URL
+
+   A single pass over the name which neither changes it nor allocates anything. Each
+   part is given as an offset and length in the name, with a start of -1 for a part
+   which is not there.
+   
+ */
+
+typedef struct {
+	int start;
+	int length;
+} HTSpan;
+
+typedef struct {
+	HTSpan access;    /* Before the ':' */
+	HTSpan host;      /* After "//", with any port */
+	HTSpan port;      /* After a ':' in host */
+	HTSpan path;      /* From the '/' after host, or relative; to the anchor */
+	HTSpan query;     /* After a '?' in path */
+	HTSpan anchor;    /* After the '#' */
+} HTURLSpans;
+
+void HTParseSpans(const char* name, HTURLSpans* spans);
+
+/*
+
+HTParseRelative:  Parse many URLs relative to one base
+
+   HTParseSetBase scans a base name once; HTParseRelative then works as HTParseInto with
+   that as the related name. The base name is not copied, so must not change or go away
+   while the base is in use.
+   
+ */
+
+typedef struct {
+	const char* name;
+	HTURLSpans spans;
+} HTParseBase;
+
+void HTParseSetBase(HTParseBase* base, const char* name);
+
+int HTParseRelative(
+		const char* aName, const HTParseBase* base, int wanted, char* buffer,
+		int size);
+
+/*
+
+HTCanonicalInto:  Put an address in canonical form
+
+   Addresses which can only mean the same thing come out the same: the access and host
+   in lower case, with no default port for the access and no trailing dot; escapes of
+   letters, digits and "-._~" undone and other escapes in upper case; the path
+   simplified as by HTSimplify, and "/" if empty after a host. The address should be
+   absolute. The result and return value are as for HTParseInto.
+   
+ */
+
+int HTCanonicalInto(const char* address, char* buffer, int size);
+
+/*
+
+HTFingerprintOf:  64 bit hash of a string
+
+   FNV-1a, in two longs of 32 bits each so as not to need a 64 bit type. Given canonical
+   addresses, equal fingerprints almost certainly mean equal addresses.
+   
+ */
+
+typedef struct {
+	unsigned long high;
+	unsigned long low;
+} HTFingerprint;
+
+void HTFingerprintOf(const char* string, HTFingerprint* fingerprint);
+
 
 /*
 
@@ -67,7 +166,7 @@ HTSimplify: Simplify a UTL
    A URL is allowed to contain the seqeunce xxx/../ which may be replaced by "" , and the
    seqeunce "/./" which may be replaced by "/". Simplification helps us recognize
    duplicate filenames. It doesn't deal with soft links, though. The new (shorter)
-   filename overwrites the old.
+   filename overwrites the old, in one pass whose time is linear in its length.
    
  */
 
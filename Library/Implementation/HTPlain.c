@@ -87,7 +87,7 @@ static void HTPlain_abort(HTStream* me, HTError e) {
 */
 const HTStreamClass HTPlain = {
 		"SocketWriter", HTPlain_free, HTPlain_abort, HTPlain_put_character,
-		HTPlain_put_string, HTPlain_write, };
+		HTPlain_put_string, HTPlain_write, NULL };
 
 
 /*		New object
@@ -18,8 +18,40 @@
 
 #include <HTSTD.h>
 #include <HTFile.h>
+#include <HTParse.h>
 
 #define LINE_LENGTH 256
+#define CACHE_SIZE 256    /* Hash slots, one translation each. Power of 2 */
+
+#ifdef __GNUC__
+#define LOAD(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define ADD(p, n) __atomic_fetch_add((p), (n), __ATOMIC_SEQ_CST)
+#define EXCHANGE(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define CAS(p, old, new) \
+	cas_pointer((void**) (p), (void*) (old), (void*) (new))
+#define TRY_LOCK(p) (!__atomic_exchange_n((p), 1, __ATOMIC_SEQ_CST))
+
+static HTBool cas_pointer(void** p, void* old, void* new) {
+	return __atomic_compare_exchange_n(
+			p, &old, new, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) ?
+		   HT_TRUE : HT_FALSE;
+}
+#else
+#define LOAD(p) (*(p))
+#define STORE(p, v) (*(p) = (v))
+#define ADD(p, n) ((*(p) += (n)) - (n))
+#define EXCHANGE(p, v) exchange_pointer((void**) (p), (void*) (v))
+#define CAS(p, old, new) \
+	(*(p) == (old) ? (*(p) = (new), HT_TRUE) : HT_FALSE)
+#define TRY_LOCK(p) (*(p) ? HT_FALSE : (*(p) = 1, HT_TRUE))
+
+static void* exchange_pointer(void** p, void* v) {
+	void* old = *p;
+	*p = v;
+	return old;
+}
+#endif
 
 
 typedef struct _rule {
@@ -27,29 +59,242 @@ typedef struct _rule {
 	HTRuleOp op;
 	char* pattern;
 	char* equiv;
+	int index;        /* Position in the list, once compiled */
+	struct _rule* next_here;    /* Next with the same prefix */
 } rule;
 
+/*	Compiled rules
+**
+**	The part of each pattern before any '*' must match the start of a
+**	string for the rule to apply, so rules are indexed in a tree by that
+**	prefix, one node per character. A node has the rules whose prefix
+**	ends there, in list order; the nodes for the first character hang
+**	from a table rather than a list. Only rules at nodes along the path
+**	of a string are tried against it.
+*/
+typedef struct _HTRuleNode HTRuleNode;
+struct _HTRuleNode {
+	HTRuleNode* child;        /* First of those one character on */
+	HTRuleNode* sibling;      /* Next with the same parent */
+	HTRuleNode* next_node;    /* All nodes, for freeing */
+	rule* rules;              /* Whose prefix ends here */
+	rule* last_rule;
+	char c;
+};
+
+/*	Translations are remembered in a table indexed by a hash of the
+**	string translated, each new one putting out any old in its slot.
+**	An entry is not changed once made, so one which is put out may
+**	still be being read, and is retired rather than freed.
+*/
+typedef struct _HTRuleCacheEntry HTRuleCacheEntry;
+struct _HTRuleCacheEntry {
+	HTRuleCacheEntry* next_retired;
+	char* result;        /* 0 for a failure */
+	char required[1];    /* More allocated */
+};
+
+struct _HTRuleSet {
+	rule* rules;    /* Pointer to first on list */
+	rule* rule_tail;    /* Pointer to last on list */
+	HTBool published;    /* So compiled, and never changed again */
+	rule* empty_prefix;    /* Rules starting with '*' */
+	rule* empty_prefix_last;
+	HTRuleNode* first_char[256];
+	HTRuleNode* all_nodes;
+	HTRuleCacheEntry* cache[CACHE_SIZE];
+	HTRuleSet* next_retired;
+};
+
 /*	Module-wide variables
 **	---------------------
+**
+**	Translation reads the published set without a lock. Something taken
+**	out of use -- a set replaced, or a cache entry put out -- is retired,
+**	and freed only when no translation which began before then can still
+**	be running:
+**
+**	-	A translation counts itself in the active count for the parity
+**		of the epoch while it runs, checking that the epoch has not
+**		moved on as it did so.
+**	-	To free what has been retired, it is set aside and the epoch
+**		moved on. Later translations count in the other parity, so once
+**		the count for the old one is 0 what was set aside can be freed.
+**	-	Nothing waits for that. One thread at a time, if no other is,
+**		takes a step: freeing what was set aside if it can, else setting
+**		aside what has been retired since. Publishing takes a step, and
+**		so does a translation which finds many entries retired.
+**
+**	This needs the GCC/Clang __atomic builtins. Other compilers get
+**	plain loads and stores, which are only safe with a single thread.
 */
 
-static rule* rules = 0;    /* Pointer to first on list */
-#ifndef PUT_ON_HEAD
-static rule* rule_tail = 0;    /* Pointer to last on list */
-#endif
+static HTRuleSet* in_use = 0;    /* Published */
+static HTRuleSet* staging = 0;    /* Changed by HTAddRule etc */
+static unsigned long epoch = 0;
+static long active[2];
+static int reclaiming = 0;    /* A thread is taking a step */
+static HTRuleSet* retired_sets = 0;
+static HTRuleCacheEntry* retired_entries = 0;
+static long retired_count = 0;    /* Entries not yet freed */
+static HTRuleSet* aside_sets = 0;    /* Only while reclaiming */
+static HTRuleCacheEntry* aside_entries = 0;
 
-/*	Add rule to the list					HTAddRule()
-**	--------------------
+
+/*	Epochs
+**	------
+*/
+static int enter(void) {
+	for(;;) {
+		unsigned long e = LOAD(&epoch);
+		ADD(&active[e & 1], 1);
+		if(LOAD(&epoch) == e) return (int) (e & 1);
+		ADD(&active[e & 1], -1);    /* Moved on: count in the new one */
+	}
+}
+
+static void leave(int parity) {
+	ADD(&active[parity], -1);
+}
+
+
+/*	Free a set
+**	----------
+*/
+static void free_set(HTRuleSet* set) {
+	int i;
+
+	while(set->all_nodes) {
+		HTRuleNode* node = set->all_nodes;
+		set->all_nodes = node->next_node;
+		free(node);
+	}
+	while(set->rules) {
+		rule* temp = set->rules;
+		set->rules = temp->next;
+		free(temp->pattern);
+		free(temp->equiv);
+		free(temp);
+	}
+	for(i = 0; i < CACHE_SIZE; i++) {
+		if(set->cache[i]) {
+			free(set->cache[i]->result);
+			free(set->cache[i]);
+		}
+	}
+	free(set);
+}
+
+
+/*	Free what has been retired
+**	----------------------------
 **
-**  On entry,
-**	pattern		points to 0-terminated string containing a single "*"
-**	equiv		points to the equivalent string with * for the
-**			place where the text matched by * goes.
-**  On exit,
-**	returns		0 if success, -1 if error.
+**	Takes a step if no other thread is, as described above.
 */
+static void reclaim(void) {
+	if(!TRY_LOCK(&reclaiming)) return;
+
+	if(aside_sets || aside_entries) {
+		if(LOAD(&active[(LOAD(&epoch) + 1) & 1]) == 0) {
+			while(aside_sets) {
+				HTRuleSet* next = aside_sets->next_retired;
+				free_set(aside_sets);
+				aside_sets = next;
+			}
+			while(aside_entries) {
+				HTRuleCacheEntry* next = aside_entries->next_retired;
+				free(aside_entries->result);
+				free(aside_entries);
+				aside_entries = next;
+				ADD(&retired_count, -1);
+			}
+		}
+	}
+	else {
+		aside_sets = EXCHANGE(&retired_sets, (HTRuleSet*) 0);
+		aside_entries = EXCHANGE(&retired_entries, (HTRuleCacheEntry*) 0);
+		if(aside_sets || aside_entries) ADD(&epoch, 1);
+	}
+	STORE(&reclaiming, 0);
+}
+
+static void retire_entry(HTRuleCacheEntry* entry) {
+	do {
+		entry->next_retired = LOAD(&retired_entries);
+	} while(!CAS(&retired_entries, entry->next_retired, entry));
+	if(ADD(&retired_count, 1) + 1 > CACHE_SIZE) reclaim();
+}
+
+
+/*	Compile the rules
+**	-----------------
+*/
+static HTRuleNode* child_node(HTRuleSet* set, HTRuleNode** first, char c) {
+	HTRuleNode* node;
+
+	for(node = *first; node; node = node->sibling) {
+		if(node->c == c) return node;
+	}
+	node = calloc(1, sizeof(*node));
+	if(node == NULL) HTOOM(__FILE__, "HTRuleSet_publish");
+	node->c = c;
+	node->sibling = *first;
+	*first = node;
+	node->next_node = set->all_nodes;
+	set->all_nodes = node;
+	return node;
+}
+
+static void compile_rules(HTRuleSet* set) {
+	rule* r;
+	int index = 0;
+
+	for(r = set->rules; r; r = r->next) {
+		const char* p = r->pattern;
+		rule** here;
+		rule** last;
+
+		r->index = index++;
+		r->next_here = 0;
+		if(!*p || *p == '*') {
+			here = &set->empty_prefix;
+			last = &set->empty_prefix_last;
+		}
+		else {
+			HTRuleNode* node = child_node(
+					set, &set->first_char[(unsigned char) *p], *p);
+			for(p++; *p && *p != '*'; p++) {
+				node = child_node(set, &node->child, *p);
+			}
+			here = &node->rules;
+			last = &node->last_rule;
+		}
+		if(*last) {
+			(*last)->next_here = r;
+		}
+		else { *here = r; }
+		*last = r;
+	}
+	if(TRACE) printf("HTRule: %d rules compiled\n", index);
+}
 
-int HTAddRule(
+
+/*	Rules and sets						HTRuleSet_new()
+**	--------------
+*/
+HTRuleSet* HTRuleSet_new(void) {
+	HTRuleSet* set = calloc(1, sizeof(*set));
+
+	if(set == NULL) HTOOM(__FILE__, "HTRuleSet_new");
+	return set;
+}
+
+void HTRuleSet_free(HTRuleSet* set) {
+	if(set && !set->published) free_set(set);
+}
+
+
+static rule* new_rule(
 		HTRuleOp op, const char* pattern,
 		const char* equiv) { /* BYTE_ADDRESSING removed and memory check - AS - 1 Sep 93 */
 	rule* temp;
@@ -73,22 +318,108 @@ int HTAddRule(
 
 	strcpy(pPattern, pattern);
 	if(TRACE) printf("Rule: For `%s' op %i `%s'\n", pattern, op, equiv);
+	return temp;
+}
+
+static void append_rule(HTRuleSet* set, rule* temp) {
+	temp->next = 0;
+	if(set->rule_tail) { set->rule_tail->next = temp; }
+	else { set->rules = temp; }
+	set->rule_tail = temp;
+}
+
+
+/*	Add rule to a set					HTRuleSet_add()
+**	-----------------
+**
+**  On entry,
+**	pattern		points to 0-terminated string containing a single "*"
+**	equiv		points to the equivalent string with * for the
+**			place where the text matched by * goes.
+**  On exit,
+**	returns		0 if success, -1 if error.
+*/
+
+int HTRuleSet_add(
+		HTRuleSet* set, HTRuleOp op, const char* pattern, const char* equiv) {
+	rule* temp;
+
+	if(set->published) return -1;
+	temp = new_rule(op, pattern, equiv);
 
 #ifdef PUT_ON_HEAD
-	temp->next = rules;
-	rules = temp;
+	temp->next = set->rules;
+	set->rules = temp;
+	if(!set->rule_tail) set->rule_tail = temp;
 #else
-	temp->next = 0;
-	if(rule_tail) { rule_tail->next = temp; }
-	else { rules = temp; }
-	rule_tail = temp;
+	append_rule(set, temp);
 #endif
 
-
 	return 0;
 }
 
 
+/*	Put a set in use					HTRuleSet_publish()
+**	----------------
+**
+**	The set is compiled, then swapped for the one in use, which is
+**	freed once no translation can be using it. Rules staged by HTAddRule
+**	and the like are a copy of the old set, so they are thrown away;
+**	otherwise the next HTTranslate would put the old rules back.
+*/
+void HTRuleSet_publish(HTRuleSet* set) {
+	HTRuleSet* old;
+	HTRuleSet* staged;
+
+	if(set->published) return;
+	staged = EXCHANGE(&staging, (HTRuleSet*) 0);
+	if(staged && staged != set) {
+		if(TRACE) printf("HTRule: Staged rules replaced, not used\n");
+		HTRuleSet_free(staged);
+	}
+	compile_rules(set);
+	set->published = HT_TRUE;
+	old = EXCHANGE(&in_use, set);
+	if(old) {
+		do {
+			old->next_retired = LOAD(&retired_sets);
+		} while(!CAS(&retired_sets, old->next_retired, old));
+	}
+	reclaim();
+}
+
+
+/*	The staged rules
+**	----------------
+**
+**	HTAddRule, HTClearRules and HTLoadRules change a copy of the rules
+**	in use, which the next HTTranslate publishes.
+*/
+static HTRuleSet* staging_set(void) {
+	if(!staging) {
+		int parity = enter();
+		HTRuleSet* set = LOAD(&in_use);
+		rule* r;
+
+		staging = HTRuleSet_new();
+		for(r = set ? set->rules : 0; r; r = r->next) {    /* In order */
+			append_rule(staging, new_rule(r->op, r->pattern, r->equiv));
+		}
+		leave(parity);
+	}
+	return staging;
+}
+
+
+/*	Add rule to the list					HTAddRule()
+**	--------------------
+*/
+
+int HTAddRule(HTRuleOp op, const char* pattern, const char* equiv) {
+	return HTRuleSet_add(staging_set(), op, pattern, equiv);
+}
+
+
 /*	Clear all rules						HTClearRules()
 **	---------------
 **
@@ -100,18 +431,71 @@ int HTAddRule(
 **	HTAddRule()
 */
 int HTClearRules(void) {
-	while(rules) {
-		rule* temp = rules;
-		rules = temp->next;
-		free(temp->pattern);
-		free(temp->equiv);
-		free(temp);
+	HTRuleSet_free(staging);
+	staging = HTRuleSet_new();
+	return 0;
+}
+
+
+/*	Match one rule
+**	--------------
+**
+** On exit,
+**	returns		HT_TRUE if the pattern matches s, when
+**	*rest		is where the text matched by '*' starts in s
+**	*matched	is its length, or -1 if the pattern had no '*'
+**			or matched without using it.
+*/
+static HTBool rule_matches(
+		const rule* r, const char* s, const char** rest, int* matched) {
+	const char* p = r->pattern;
+	const char* q = s;
+
+	for(; *p && *q; p++, q++) {   /* Find first mismatch */
+		if(*p != *q) break;
 	}
-#ifndef PUT_ON_HEAD
-	rule_tail = 0;
-#endif
 
-	return 0;
+	if(*p == '*') {        /* Match up to wildcard */
+		/* Amount to match to wildcard */
+		int m = (int) strlen(q) - (int) strlen(p + 1);
+		if(m < 0) return HT_FALSE;           /* tail is too short to match */
+		if(0 != strcmp(q + m, p + 1)) return HT_FALSE;    /* Tail mismatch */
+		*matched = m;
+	}
+	else {                /* Not wildcard */
+		if(*p != *q) return HT_FALSE;    /* plain mismatch */
+		*matched = -1;
+	}
+	*rest = q;
+	return HT_TRUE;
+}
+
+/*	The first rule after the one numbered last which matches s
+*/
+static rule* first_match(
+		const HTRuleSet* set, const char* s, int last, const char** rest,
+		int* matched) {
+	rule* best = 0;
+	HTRuleNode* node = 0;
+	const char* q = s;
+	rule* r = set->empty_prefix;
+
+	for(;;) {    /* Rules at each node down the path of s */
+		for(; r && (!best || r->index < best->index); r = r->next_here) {
+			if(r->index > last && rule_matches(r, s, rest, matched)) {
+				best = r;
+				break;
+			}
+		}
+
+		if(!*q) break;
+		node = node ? node->child : set->first_char[(unsigned char) *q];
+		for(; node && node->c != *q; node = node->sibling);
+		if(!node) break;
+		q++;
+		r = node->rules;
+	}
+	return best;
 }
 
 
@@ -128,29 +512,17 @@ int HTClearRules(void) {
 **			occured, then it is a copy of te original.
 */
 
-char* HTTranslate(const char* required) {
+static char* translate(const HTRuleSet* set, const char* required) {
 	rule* r;
+	const char* q;
+	int m;    /* Number of characters matched against wildcard */
+	int last;
 	char* current = malloc(strlen(required) + 1);
 	if(current == NULL) HTOOM(__FILE__, "HTTranslate"); /* NT */
 	strcpy(current, required);
 
-	for(r = rules; r; r = r->next) {
-		char* p = r->pattern;
-		int m = 0;   /* Number of characters matched against wildcard */
-		const char* q = current;
-		for(; *p && *q; p++, q++) {   /* Find first mismatch */
-			if(*p != *q) break;
-		}
-
-		if(*p == '*') {        /* Match up to wildcard */
-			/* Amount to match to wildcard */
-			m = (unsigned) (strlen(q) - strlen(p + 1));
-			if(m < 0) continue;           /* tail is too short to match */
-			if(0 != strcmp(q + m, p + 1)) continue;    /* Tail mismatch */
-		}
-		else                /* Not wildcard */
-		if(*p != *q) continue;    /* plain mismatch: go to next rule */
-
+	for(last = -1; (r = first_match(set, current, last, &q, &m));
+		last = r->index) {
 		switch(r->op) {        /* Perform operation */
 			case HT_Pass:                /* Authorised */
 				if(!r->equiv) {
@@ -162,7 +534,7 @@ char* HTTranslate(const char* required) {
 				/* TODO: Attribute fallthrough. */
 			/* FALLTHROUGH */
 			case HT_Map:
-				if(*p == *q) { /* End of both strings, no wildcard */
+				if(m < 0) { /* End of both strings, no wildcard */
 					if(TRACE) {
 						printf(
 								"For `%s' using `%s'\n", current, r->equiv);
@@ -213,6 +585,7 @@ char* HTTranslate(const char* required) {
 			case HT_Invalid:
 			case HT_Fail:                /* Unauthorised */
 				if(TRACE) printf("HTRule: *** FAIL `%s'\n", current);
+				free(current);
 				return 0;
 
 		} /* if tail matches ... switch operation */
@@ -223,14 +596,58 @@ char* HTTranslate(const char* required) {
 	return current;
 }
 
+char* HTTranslate(const char* required) {
+	HTFingerprint fingerprint;
+	HTRuleSet* set;
+	HTRuleCacheEntry* entry;
+	HTRuleCacheEntry** slot;
+	char* result = 0;
+	int parity;
+
+	if(LOAD(&staging)) {    /* Rules changed by HTAddRule etc */
+		HTRuleSet* changed = EXCHANGE(&staging, (HTRuleSet*) 0);
+		if(changed) HTRuleSet_publish(changed);
+	}
+
+	parity = enter();
+	set = LOAD(&in_use);
+	if(!set) {
+		leave(parity);
+		StrAllocCopy(result, required);
+		return result;
+	}
+
+	HTFingerprintOf(required, &fingerprint);
+	slot = &set->cache[fingerprint.low & (CACHE_SIZE - 1)];
+	entry = LOAD(slot);
+	if(entry && 0 == strcmp(entry->required, required)) {
+		if(TRACE) printf("HTRule: `%s' translated before\n", required);
+		if(entry->result) StrAllocCopy(result, entry->result);
+		leave(parity);
+		return result;
+	}
+
+	result = translate(set, required);
+	entry = malloc(sizeof(*entry) + strlen(required));
+	if(entry == NULL) HTOOM(__FILE__, "HTTranslate");
+	strcpy(entry->required, required);
+	entry->result = 0;
+	if(result) StrAllocCopy(entry->result, result);
+	entry = EXCHANGE(slot, entry);
+	leave(parity);
+	if(entry) retire_entry(entry);
+	return result;
+}
+
 /*	Load one line of configuration
 **	------------------------------
 **
 **	Call this, for example, to load a X resource with config info.
+**	Rules go into set, or if that is 0 the staged rules.
 **
 ** returns	0 OK, < 0 syntax error.
 */
-int HTSetConfiguration(const char* config) {
+static int configure(HTRuleSet* set, const char* config) {
 	HTRuleOp op;
 	char* line = NULL;
 	char* pointer = line;
@@ -287,13 +704,17 @@ int HTSetConfiguration(const char* config) {
 			fprintf(stderr, "HTRule: Bad rule `%s'\n", config);
 		}
 		else {
-			HTAddRule(op, word2, word3);
+			HTRuleSet_add(set ? set : staging_set(), op, word2, word3);
 		}
 	}
 	free(line);
 	return 0;
 }
 
+int HTSetConfiguration(const char* config) {
+	return configure(0, config);
+}
+
 
 /*	Load the rules from a file				HtLoadRules()
 **	--------------------------
@@ -309,7 +730,7 @@ int HTSetConfiguration(const char* config) {
 **	The strings may not contain spaces.
 */
 
-int HTLoadRules(const char* filename) {
+static int load(HTRuleSet* set, const char* filename) {
 	FILE* fp = fopen(filename, "r");
 	char line[LINE_LENGTH + 1];
 
@@ -319,8 +740,35 @@ int HTLoadRules(const char* filename) {
 	}
 	for(;;) {
 		if(!fgets(line, LINE_LENGTH + 1, fp)) break;    /* EOF or error */
-		(void) HTSetConfiguration(line);
+		(void) configure(set, line);
 	}
 	fclose(fp);
 	return 0;        /* No error or syntax errors ignored */
 }
+
+int HTLoadRules(const char* filename) {
+	return load(0, filename);
+}
+
+int HTRuleSet_load(HTRuleSet* set, const char* filename) {
+	if(set->published) return -1;
+	return load(set, filename);
+}
+
+
+/*	Replace the rules from a file				HTReloadRules()
+**	-----------------------------
+**
+**	The new set is built before it is put in place, so translations go
+**	on meanwhile with the old rules.
+*/
+int HTReloadRules(const char* filename) {
+	HTRuleSet* set = HTRuleSet_new();
+
+	if(HTRuleSet_load(set, filename) < 0) {
+		HTRuleSet_free(set);
+		return -1;
+	}
+	HTRuleSet_publish(set);
+	return 0;
+}
@@ -24,6 +24,52 @@ typedef enum _HTRuleOp {
 
 /*
 
+Rule sets
+
+   The rules in use are a set which is never changed. HTTranslate reads it without a
+   lock, so a server may translate in many threads while the rules are replaced. A new
+   set is built with HTRuleSet_new, HTRuleSet_add and HTRuleSet_load, then put in use with
+   HTRuleSet_publish. From then on the set belongs to the library and cannot be added to.
+   The set it replaces is freed later, once no translation can be using it.
+   
+   HTAddRule, HTClearRules, HTSetConfiguration and HTLoadRules change a staged copy of
+   the rules in use, which the next HTTranslate publishes. They must not be called while
+   another thread translates. HTRuleSet_publish and HTReloadRules free any staged copy
+   not yet published, as it was made from the rules being replaced: changes made that way
+   before a reload are lost, and must be made again after it if still wanted.
+   
+ */
+
+typedef struct _HTRuleSet HTRuleSet;
+
+HTRuleSet* HTRuleSet_new(void);
+
+int HTRuleSet_add(
+		HTRuleSet* set, HTRuleOp op, const char* pattern, const char* equiv);
+
+int HTRuleSet_load(HTRuleSet* set, const char* filename);
+
+void HTRuleSet_publish(HTRuleSet* set);
+
+/*
+
+   HTRuleSet_free frees a set which has not been published.
+   
+ */
+void HTRuleSet_free(HTRuleSet* set);
+
+/*
+
+HTReloadRules:  Replace the rules in use with those from a file
+
+   Builds a new set from the file and publishes it. Returns 0, or -1 if the file cannot
+   be opened, when the rules in use are kept.
+   
+ */
+int HTReloadRules(const char* filename);
+
+/*
+
 HTAddRule:  Add rule to the list
 
   ON ENTRY,
@@ -37,9 +83,8 @@ HTAddRule:  Add rule to the list
   
   returns                0 if success, -1 if error.
                          
-   Note that if BYTE_ADDRESSING is set, the three blocks required are allocated and
-   deallocated as one. This will save time and storage, when malloc's allocation units are
-   large.
+   HTRuleSet_add is the same for a set which has not been published; it returns -1 for
+   one which has.
    
  */
 int HTAddRule(HTRuleOp op, const char* pattern, const char* equiv);
@@ -65,6 +110,11 @@ int HTClearRules(void);
 
 HTTranslate: Translate by rules
 
+   The rules are indexed by what comes before any "*" in their patterns when a set is
+   published, so only those which could match are tried. Up to 256 translations are
+   remembered with the set, one per hash slot: a new translation replaces whatever
+   was in its slot.
+   
  */
 
 /*
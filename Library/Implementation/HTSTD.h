@@ -77,6 +77,14 @@
 # include <sys/time.h>
 # include <sys/param.h>
 # include <sys/file.h>
+# include <sys/uio.h>
+# include <sys/mman.h>
+
+# ifdef __linux__
+#  ifndef USE_DIRENT
+#   define USE_DIRENT    /* Directories can be read, for .multi negotiation */
+#  endif
+# endif
 
 # include <sys/socket.h>
 # include <netinet/in.h>
@@ -17,6 +17,17 @@
 
 typedef struct _HTStream HTStream;
 
+/*
+
+   A block of data in a list of blocks, as passed to put_iovec. It is our own type rather
+   than struct iovec so that it exists everywhere.
+   
+ */
+typedef struct _HTIovec {
+	const char* base;
+	int len;
+} HTIovec;
+
 /*
 
    These are the common methods of all streams. They should be self-explanatory, except
@@ -25,6 +36,11 @@ typedef struct _HTStream HTStream;
    
    The put_block method was write, but this upset systems whiuch had macros for write().
    
+   The put_iovec method writes several blocks as one, so that a stream which can pass them
+   on together (to a socket with writev() for example) gets the chance. It is optional:
+   streams which leave it 0 get the blocks one by one through put_block. Call it through
+   HTPutIovec, which does that for you.
+   
  */
 typedef struct _HTStreamClass {
 
@@ -41,6 +57,8 @@ typedef struct _HTStreamClass {
 	void (* put_block)(
 			HTStream* me, const char* str, int len);
 
+	void (* put_iovec)(
+			HTStream* me, const HTIovec* iov, int count);
 
 } HTStreamClass;
 
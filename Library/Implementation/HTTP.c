@@ -39,6 +39,8 @@
 #include <ctype.h>
 #include <HTAlert.h>
 #include <HTMIME.h>
+#include <HTInflate.h>
+#include <HTChunk.h>
 #include <HTML.h>        /* SCW */
 #include <HTInit.h>        /* SCW */
 
@@ -50,6 +52,149 @@ struct _HTStream {
 extern char* HTAppName;    /* Application name: please supply */
 extern char* HTAppVersion;    /* Application version: please supply */
 
+
+/*		Build the request header block			request_headers()
+**		==============================
+**
+**	Everything after the request line is the same for every request
+**	until the presentations, conversions or the application name
+**	change, so it is kept and only rebuilt when they do.
+**
+** On exit,
+**	returns	the header block, including the blank line which ends it.
+**		The string belongs to this module.
+*/
+static char* header_block = NULL;
+static long header_version = -1;    /* HTPresentationsVersion it matches */
+static const char* header_app_name = NULL;
+static const char* header_app_version = NULL;
+
+static const char* request_headers(void) {
+	HTAtom* present = WWW_PRESENT;
+	HTList* cur;
+	HTPresentation* pres;
+	char line[256];    /*@@@@ */
+
+	if(!HTPresentations) HTFormatInit();
+
+	if(header_block && header_version == HTPresentationsVersion &&
+	   header_app_name == HTAppName && header_app_version == HTAppVersion) {
+		return header_block;
+	}
+
+	if(header_block) free(header_block);
+	header_block = NULL;
+
+	{
+		HTChunk* chunk = HTChunkCreate(512);
+
+		cur = HTPresentations;
+		while((pres = HTList_nextObject(cur))) {
+			if(pres->rep_out == present) {
+				if(pres->quality != 1.0) {
+					sprintf(
+							line, "Accept: %s q=%.3f%c%c",
+							HTAtom_name(pres->rep), pres->quality, '\r', '\n');
+				}
+				else {
+					sprintf(
+							line, "Accept: %s%c%c", HTAtom_name(pres->rep),
+							'\r', '\n');
+				}
+				HTChunkPuts(chunk, line);
+			}
+		}
+
+		sprintf(
+				line, "User-Agent:  %s/%s  libwww/%s%c%c",
+				HTAppName ? HTAppName : "unknown",
+				HTAppVersion ? HTAppVersion : "0.0", HTLibraryVersion, '\r',
+				'\n');
+		HTChunkPuts(chunk, line);
+
+		if(HTAcceptEncodings) {
+			sprintf(
+					line, "Accept-Encoding: %s%c%c", HTAcceptEncodings, '\r',
+					'\n');
+			HTChunkPuts(chunk, line);
+		}
+
+		HTChunkPutc(chunk, '\r');    /* Blank line means "end" */
+		HTChunkPutc(chunk, '\n');
+		HTChunkTerminate(chunk);
+
+		header_block = chunk->data;    /* Keep the data, lose the chunk */
+		free(chunk);
+	}
+
+	header_version = HTPresentationsVersion;
+	header_app_name = HTAppName;
+	header_app_version = HTAppVersion;
+	return header_block;
+}
+
+
+/*		Send the request				send_request()
+**		================
+**
+**	The request line and header block go out in one writev() where we
+**	have one, so they leave in one segment without being copied together.
+**	Either way what is not taken at once is sent again until all has gone.
+**
+** On exit,
+**	returns	<0 if the write failed.
+*/
+static int send_request(int s, const char* line, const char* headers) {
+	size_t line_length = strlen(line);
+	size_t headers_length = strlen(headers);
+#ifdef _WIN32
+	char* command = malloc(line_length + headers_length + 1);
+	size_t length = line_length + headers_length;
+	size_t sent = 0;
+	if(command == NULL) HTOOM(__FILE__, "send_request");
+	strcpy(command, line);
+	strcpy(command + line_length, headers);
+	while(sent < length) {    /* As writev below: until it has all gone */
+		int status = send(s, command + sent, (int) (length - sent), 0);
+		if(status < 0) {
+			if(WSAGetLastError() == WSAEINTR) continue;
+			free(command);
+			return -1;
+		}
+		sent += (size_t) status;
+	}
+	free(command);
+	return 0;
+#else
+	struct iovec iov[2];
+	struct iovec* next = iov;
+	int count = 2;
+
+	iov[0].iov_base = (void*) line;
+	iov[0].iov_len = line_length;
+	iov[1].iov_base = (void*) headers;
+	iov[1].iov_len = headers_length;
+
+	while(count > 0) {
+		ssize_t status = writev(s, next, count);
+		if(status < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		while(count > 0 && (size_t) status >= next->iov_len) {
+			status -= next->iov_len;    /* This part all went */
+			next++;
+			count--;
+		}
+		if(count > 0) {        /* Part written: carry on from there */
+			next->iov_base = (char*) next->iov_base + status;
+			next->iov_len -= status;
+		}
+	}
+	return 0;
+#endif
+}
+
 /*		Load Document from HTTP Server			HTLoadHTTP()
 **		==============================
 **
@@ -169,58 +314,13 @@ int HTLoadHTTP(
 
 	strcat(command, crlf);    /* '\r' '\n', as in rfc 977 */
 
-	if(extensions) {
-
-		int n;
-		int i;
-		HTAtom* present = WWW_PRESENT;
-		char line[256];    /*@@@@ */
-
-		if(!HTPresentations) HTFormatInit();
-		n = HTList_count(HTPresentations);
-
-		for(i = 0; i < n; i++) {
-			HTPresentation* pres = HTList_objectAt(HTPresentations, i);
-			if(pres->rep_out == present) {
-				if(pres->quality != 1.0) {
-					sprintf(
-							line, "Accept: %s q=%.3f%c%c",
-							HTAtom_name(pres->rep), pres->quality, '\r', '\n');
-				}
-				else {
-					sprintf(
-							line, "Accept: %s%c%c", HTAtom_name(pres->rep),
-							'\r', '\n');
-				}
-				StrAllocCat(command, line);
-
-			}
-		}
-
-		sprintf(
-				line, "User-Agent:  %s/%s  libwww/%s%c%c",
-				HTAppName ? HTAppName : "unknown",
-				HTAppVersion ? HTAppVersion : "0.0", HTLibraryVersion, '\r',
-				'\n');
-		StrAllocCat(command, line);
-	}
-
-	StrAllocCat(command, crlf);    /* Blank line means "end" */
+	{
+		const char* headers = extensions ? request_headers() : crlf;
 
-	if(TRACE) fprintf(stderr, "HTTP Tx: %s\n", command);
+		if(TRACE) fprintf(stderr, "HTTP Tx: %s%s\n", command, headers);
 
-/*	Translate into ASCII if necessary
-*/
-#ifdef NOT_ASCII
-	{
-		char * p;
-	for(p = command; *p; p++) {
-		*p = (*p);
-	}
+		status = send_request(s, command, headers);
 	}
-#endif
-
-	status = write(s, command, (int) strlen(command));
 	free(command);
 	if(status < 0) {
 		if(TRACE) fprintf(stderr, "HTTPAccess: Unable to send command.\n");
@@ -423,7 +423,8 @@ static void WSRCParser_abort(HTStream* me, HTError e) {
 
 HTStreamClass WSRCParserClass = {
 		"WSRCParser", WSRCParser_free, WSRCParser_abort,
-		WSRCParser_put_character, WSRCParser_put_string, WSRCParser_write
+		WSRCParser_put_character, WSRCParser_put_string, WSRCParser_write,
+		NULL
 
 };
 
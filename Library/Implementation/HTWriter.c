@@ -1,14 +1,49 @@
 /*		FILE WRITER			HTWrite.c
 **		===========
 **
+**	Output is collected in a buffer which starts at HTWriterBufferSize
+**	bytes. A buffer which keeps filling up with small writes is doubled,
+**	up to HTWriterMaxBuffer, so that a chatty producer costs fewer system
+**	calls. Blocks too big for the space left go straight out together
+**	with whatever is buffered, in one writev() and without being copied.
+**
+**	Partial writes are carried on from where they stopped. A socket in
+**	non-blocking mode which returns EAGAIN is waited for with poll().
 */
 #include <HTWriter.h>
 
-#define BUFFER_SIZE 4096    /* Tradeoff */
-
 #include <HTUtils.h>
 #include <HTSTD.h>
 
+int HTWriterBufferSize = 8192;        /* Tradeoff */
+int HTWriterMaxBuffer = 65536;
+long HTWriterBytes = 0;
+long HTWriterCalls = 0;
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+
+#define SENDFILE_CHUNK 0x40000000    /* Keeps the count well inside int */
+#endif
+
+#ifdef _WIN32
+struct iovec {
+	void* iov_base;
+	size_t iov_len;
+};
+#define WOULD_BLOCK (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+#include <poll.h>
+
+#define WOULD_BLOCK (errno == EAGAIN || errno == EWOULDBLOCK)
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+#define WRITER_IOV (IOV_MAX < 64 ? IOV_MAX : 64)
+
 
 /*		HTML Object
 **		-----------
@@ -18,47 +53,154 @@ struct _HTStream {
 	const HTStreamClass* isa;
 
 	int soc;
+	char* buffer;
 	char* write_pointer;
-	char buffer[BUFFER_SIZE];
+	int size;        /* Of buffer */
+	HTBool failed;        /* Socket error: discard further output */
+	long bytes;        /* Written to the socket */
+	long calls;        /* System calls used to do it */
 #ifdef NOT_ASCII
 	HTBool	make_ascii;	/* Are we writing to the net? */
 #endif
 };
 
 
-/*	Write the buffer out to the socket
-**	----------------------------------
+/*	Wait until a non-blocking socket can take more
+**	----------------------------------------------
+**
+**	poll() because select() can't take a descriptor of FD_SETSIZE or
+**	more, which a busy server has. A Windows fd_set is a list of
+**	sockets, not a bit map, so select() is safe there.
 */
+static HTBool wait_writable(int soc) {
+#ifdef _WIN32
+	fd_set fds;
+
+	FD_ZERO(&fds);
+	FD_SET(soc, &fds);
+	return select(soc + 1, NULL, &fds, NULL, NULL) >= 0 || errno == EINTR;
+#else
+	struct pollfd pfd;
+
+	pfd.fd = soc;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+	return poll(&pfd, 1, -1) >= 0 || errno == EINTR;
+#endif
+}
 
-static void flush(HTStream* me) {
-	char* read_pointer = me->buffer;
-	char* write_pointer = me->write_pointer;
 
-#ifdef NOT_ASCCII
-	if (me->make_ascii) {
-		char * p;
-	for(p = me->buffer; p < me->write_pointer; p++)
-		*p = (*p);
-	}
-#endif
-	while(read_pointer < write_pointer) {
+/*	Write a list of blocks out to the socket
+**	----------------------------------------
+**
+**	The list is used up as it goes: a partial write leaves the first
+**	block pointing at what is still to go.
+*/
+static void write_iov(HTStream* me, struct iovec* iov, int count) {
+	while(count > 0 && !me->failed) {
 		int status;
 
-		status = write(
-				me->soc, me->buffer,
-				(unsigned) (write_pointer - read_pointer));
+#ifdef _WIN32
+		status = send(me->soc, iov->iov_base, (int) iov->iov_len, 0);
+#else
+		status = (int) writev(me->soc, iov, count);
+#endif
+		me->calls++;
 
 		if(status < 0) {
+			if(errno == EINTR) continue;
+			if(WOULD_BLOCK && wait_writable(me->soc)) continue;
 			if(TRACE) {
 				fprintf(
 						stderr,
 						"HTWrite: Error: write() on socket returns %d !!!\n",
 						status);
 			}
+			me->failed = HT_TRUE;
 			return;
 		}
-		read_pointer = read_pointer + status;
+		me->bytes += status;
+
+		while(count > 0 && (size_t) status >= iov->iov_len) {
+			status -= (int) iov->iov_len;
+			iov++;
+			count--;
+		}
+		if(count > 0) {    /* Partial write: carry on from where it stopped */
+			iov->iov_base = (char*) iov->iov_base + status;
+			iov->iov_len -= status;
+		}
+	}
+}
+
+
+/*	Write the buffer out to the socket
+**	----------------------------------
+*/
+static void flush(HTStream* me) {
+	struct iovec iov;
+
+#ifdef NOT_ASCCII
+	if (me->make_ascii) {
+		char * p;
+	for(p = me->buffer; p < me->write_pointer; p++)
+		*p = (*p);
+	}
+#endif
+	if(me->write_pointer > me->buffer) {
+		iov.iov_base = me->buffer;
+		iov.iov_len = me->write_pointer - me->buffer;
+		write_iov(me, &iov, 1);
+	}
+	me->write_pointer = me->buffer;
+}
+
+
+/*	Write the buffer out and make it bigger
+**	---------------------------------------
+**
+**	Called when small writes have filled the buffer.
+*/
+static void make_room(HTStream* me) {
+	flush(me);
+	if(me->size < HTWriterMaxBuffer) {
+		int size = me->size * 2 < HTWriterMaxBuffer ?
+				   me->size * 2 : HTWriterMaxBuffer;
+		char* buffer = realloc(me->buffer, size);
+
+		if(buffer) {    /* Otherwise just carry on with what we have */
+			me->buffer = buffer;
+			me->write_pointer = buffer;
+			me->size = size;
+		}
+	}
+}
+
+
+/*	Send the buffer and a list of blocks together
+**	---------------------------------------------
+*/
+static void send_with_buffer(HTStream* me, const HTIovec* blocks, int count) {
+	struct iovec iov[WRITER_IOV];
+	int n = 0;
+	int i;
+
+	if(me->write_pointer > me->buffer) {
+		iov[n].iov_base = me->buffer;
+		iov[n].iov_len = me->write_pointer - me->buffer;
+		n++;
+	}
+	for(i = 0; i < count; i++) {
+		if(blocks[i].len <= 0) continue;
+		if(n == WRITER_IOV) {
+			write_iov(me, iov, n);
+			n = 0;
+		}
+		iov[n].iov_base = (char*) blocks[i].base;
+		iov[n].iov_len = blocks[i].len;
+		n++;
 	}
+	write_iov(me, iov, n);
 	me->write_pointer = me->buffer;
 }
 
@@ -73,47 +215,72 @@ static void flush(HTStream* me) {
 */
 
 static void HTWriter_put_character(HTStream* me, char c) {
-	if(me->write_pointer == &me->buffer[BUFFER_SIZE]) flush(me);
+	if(me->write_pointer == me->buffer + me->size) make_room(me);
 	*me->write_pointer++ = c;
 }
 
 
+/*	Buffer write. Buffers can (and should!) be big.
+**	------------
+**
+**	Small blocks are added to the buffer, topping it up first if they
+**	don't fit. Big ones go out with the buffer in one call.
+*/
+static void HTWriter_write(HTStream* me, const char* s, int l) {
+	int room = (int) (me->buffer + me->size - me->write_pointer);
+	HTIovec block;
+
+	if(me->failed || l <= 0) return;
+
+	if(l <= room) {
+		memcpy(me->write_pointer, s, l);
+		me->write_pointer += l;
+		return;
+	}
+	if(l < me->size / 4) {
+		memcpy(me->write_pointer, s, room);
+		me->write_pointer += room;
+		make_room(me);
+		HTWriter_write(me, s + room, l - room);
+		return;
+	}
+	block.base = s;
+	block.len = l;
+	send_with_buffer(me, &block, 1);
+}
+
+
 /*	String handling
 **	---------------
-**
-**	Strings must be smaller than this buffer size.
 */
 static void HTWriter_put_string(HTStream* me, const char* s) {
-	int l = (int) strlen(s);
-	if(me->write_pointer + l > &me->buffer[BUFFER_SIZE]) flush(me);
-	strcpy(me->write_pointer, s);
-	me->write_pointer = me->write_pointer + l;
+	HTWriter_write(me, s, (int) strlen(s));
 }
 
 
-/*	Buffer write. Buffers can (and should!) be big.
-**	------------
+/*	Scatter/gather write
+**	--------------------
+**
+**	If the blocks fit in what is left of the buffer they are just copied
+**	in. Otherwise the buffer and the blocks go out together.
 */
-static void HTWriter_write(HTStream* me, const char* s, int l) {
+static void HTWriter_put_iovec(HTStream* me, const HTIovec* iov, int count) {
+	int total = 0;
+	int i;
 
-	const char* read_pointer = s;
-	const char* write_pointer = s + l;
+	if(me->failed) return;
 
-	flush(me);        /* First get rid of our buffer */
+	for(i = 0; i < count; i++) if(iov[i].len > 0) total += iov[i].len;
 
-	while(read_pointer < write_pointer) {
-		int status = write(me->soc, read_pointer,
-						   (unsigned) (write_pointer - read_pointer));
-		if(status < 0) {
-			if(TRACE) {
-				fprintf(
-						stderr,
-						"HTWriter_write: Error on socket output stream!!!\n");
-			}
-			return;
+	if(total <= me->buffer + me->size - me->write_pointer) {
+		for(i = 0; i < count; i++) {
+			if(iov[i].len <= 0) continue;
+			memcpy(me->write_pointer, iov[i].base, iov[i].len);
+			me->write_pointer += iov[i].len;
 		}
-		read_pointer = read_pointer + status;
+		return;
 	}
+	send_with_buffer(me, iov, count);
 }
 
 
@@ -125,7 +292,15 @@ static void HTWriter_write(HTStream* me, const char* s, int l) {
 */
 static void HTWriter_free(HTStream* me) {
 	flush(me);
+	if(TRACE) {
+		fprintf(
+				stderr, "HTWriter: %ld bytes in %ld calls, buffer %d\n",
+				me->bytes, me->calls, me->size);
+	}
+	HTWriterBytes += me->bytes;
+	HTWriterCalls += me->calls;
 	close(me->soc);
+	free(me->buffer);
 	free(me);
 }
 
@@ -142,23 +317,36 @@ static void HTWriter_abort(HTStream* me, HTError e) {
 static const HTStreamClass HTWriter = /* As opposed to print etc */
 		{
 				"SocketWriter", HTWriter_free, HTWriter_abort,
-				HTWriter_put_character, HTWriter_put_string, HTWriter_write };
+				HTWriter_put_character, HTWriter_put_string, HTWriter_write,
+				HTWriter_put_iovec };
 
 
 /*	Subclass-specific Methods
 **	-------------------------
 */
 
-HTStream* HTWriter_new(int soc) {
+static HTStream* writer_new(int soc) {
 	HTStream* me = malloc(sizeof(*me));
-	if(me == NULL) HTOOM(__FILE__, "HTML_new");
+	if(me == NULL) HTOOM(__FILE__, "HTWriter_new");
 	me->isa = &HTWriter;
 
+	me->size = HTWriterBufferSize > 0 ? HTWriterBufferSize : 1;
+	me->buffer = malloc(me->size);
+	if(me->buffer == NULL) HTOOM(__FILE__, "HTWriter_new");
+	me->write_pointer = me->buffer;
+	me->soc = soc;
+	me->failed = HT_FALSE;
+	me->bytes = 0;
+	me->calls = 0;
+	return me;
+}
+
+HTStream* HTWriter_new(int soc) {
+	HTStream* me = writer_new(soc);
+
 #ifdef NOT_ASCII
 	me->make_ascii = HT_FALSE;
 #endif
-	me->soc = soc;
-	me->write_pointer = me->buffer;
 	return me;
 }
 
@@ -167,15 +355,67 @@ HTStream* HTWriter_new(int soc) {
 */
 
 HTStream* HTASCIIWriter(int soc) {
-	HTStream* me = malloc(sizeof(*me));
-	if(me == NULL) HTOOM(__FILE__, "HTML_new");
-	me->isa = &HTWriter;
+	HTStream* me = writer_new(soc);
 
 #ifdef NOT_ASCII
 	me->make_ascii = HT_TRUE;
 #endif
-	me->soc = soc;
-	me->write_pointer = me->buffer;
 	return me;
 }
 
+
+/*	Send a file straight to the socket
+**	----------------------------------
+**
+**	When the writer is the whole of the stream stack the data need not
+**	come up into user space at all. Sending starts at the stdio position
+**	of fp, and fp is left after whatever was sent.
+*/
+HTBool HTWriter_sendFile(HTStream* me, FILE* fp) {
+#ifdef __linux__
+	off_t offset;
+	int fd = fileno(fp);
+
+	if(me->isa != &HTWriter || fd < 0) return HT_FALSE;
+#ifdef NOT_ASCII
+	if(me->make_ascii) return HT_FALSE;
+#endif
+	if(me->failed) return HT_TRUE;    /* It would all be thrown away */
+
+	offset = ftell(fp);
+	if(offset < 0) return HT_FALSE;
+	flush(me);
+
+	for(;;) {
+		int status = (int) sendfile(me->soc, fd, &offset, SENDFILE_CHUNK);
+		me->calls++;
+
+		if(status > 0) {
+			me->bytes += status;
+			continue;
+		}
+		if(status == 0) break;    /* End of file */
+		if(errno == EINTR) continue;
+		if(WOULD_BLOCK && wait_writable(me->soc)) continue;
+		if(errno == EINVAL || errno == ENOSYS) {    /* Copy the rest */
+			if(TRACE) fprintf(stderr, "HTWriter: Can't sendfile here\n");
+			fseek(fp, offset, SEEK_SET);
+			return HT_FALSE;
+		}
+		if(TRACE) {
+			fprintf(
+					stderr, "HTWriter: Error: sendfile() returns %d !!!\n",
+					status);
+		}
+		me->failed = HT_TRUE;
+		break;
+	}
+	fseek(fp, offset, SEEK_SET);
+	return HT_TRUE;
+#else
+	(void) me;
+	(void) fp;
+
+	return HT_FALSE;
+#endif
+}
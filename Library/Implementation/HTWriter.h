@@ -9,19 +9,40 @@
 **      There are two versions (identical on ASCII machines)
 **      one of which converts to ASCII on output.
 **
-**      Bugs:
-**              strings written must be less than buffer size.
+**      Output is buffered. The buffer starts at HTWriterBufferSize bytes
+**      and grows, up to HTWriterMaxBuffer, while it keeps filling up with
+**      small writes. Sockets may be non-blocking.
+**
+**      HTWriterBytes and HTWriterCalls add up the bytes written and the
+**      system calls used by every writer freed so far.
 */
 
 #ifndef HTWRITE_H
 #define HTWRITE_H
 
 #include <HTStream.h>
+#include <HTSTD.h>
+
+extern int HTWriterBufferSize;
+extern int HTWriterMaxBuffer;
+
+extern long HTWriterBytes;
+extern long HTWriterCalls;
 
 HTStream* HTWriter_new(int soc);
 
 HTStream* HTASCIIWriter(int soc);
 
+/*      Send a file straight to the socket
+**
+**      If the stream is a socket writer and the system can do it, the
+**      rest of the file is sent without being copied through the stream
+**      and HT_TRUE is returned. Otherwise HT_FALSE is returned and the
+**      caller must copy what is left of the file itself. Used by
+**      HTFileCopy.
+*/
+HTBool HTWriter_sendFile(HTStream* me, FILE* fp);
+
 #endif
 /*
 
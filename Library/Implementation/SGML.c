@@ -645,7 +645,7 @@ void SGML_write(HTStream* context, const char* str, int l) {
 */
 const HTStreamClass SGMLParser = {
 		"SGMLParser", SGML_free, SGML_abort, SGML_character, SGML_string,
-		SGML_write, };
+		SGML_write, NULL };
 
 /*	Create SGML Engine
 **	------------------
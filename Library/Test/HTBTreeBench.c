@@ -0,0 +1,581 @@
+/*		Benchmark of sorting with HTBTree		HTBTreeBench.c
+**		=================================
+**
+**	Adds made up file names in random order, as an FTP or directory
+**	listing does, walks them in order with HTBTree_next and frees the
+**	lot. This is timed for 10^3 to 10^6 names against old_add and
+**	old_next, the balanced binary tree which the sorted array replaced,
+**	copied here, and the two orders are checked to be the same. Some
+**	names differ only in case, which HTBTree_caseCompare takes as equal,
+**	so this also checks that they keep the order they were added in.
+**
+**	The old tree's rebalancing can follow a null pointer once it holds
+**	some thousands of names, so it is run in a child process and a
+**	crash is reported rather than ending the benchmark.
+**
+**	From Library/Implementation:
+**
+**	cc -O2 -I. -o /tmp/HTBTreeBench ../Test/HTBTreeBench.c HTBTree.c \
+**		HTString.c && /tmp/HTBTreeBench
+**
+**	HTBTree.c needs HTOOM from the application, so it is given here.
+*/
+
+#include <HTBTree.h>
+
+#include <HTSTD.h>
+#include <sys/wait.h>
+
+#define MAX_NAMES 1000000
+#define MAXIMUM(a, b) ((a)>(b)?(a):(b))
+
+void HTOOM(const char* file, const char* func) {
+	fprintf(stderr, "%s: %s: Out of memory\n", file, func);
+	exit(2);
+}
+
+static double now(void) {
+	struct timeval t;
+	gettimeofday(&t, 0);
+	return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+
+/*	The tree as before
+**	------------------
+*/
+typedef struct _old_element {
+	void* object;        /* User object */
+	struct _old_element* up;
+	struct _old_element* left;
+	int left_depth;
+	struct _old_element* right;
+	int right_depth;
+} old_element;
+
+typedef struct {
+	HTComparer compare;
+	old_element* top;
+} old_tree;
+
+static old_tree* old_new(HTComparer comp) {
+	old_tree* tree = malloc(sizeof(old_tree));
+	if(!tree) HTOOM(__FILE__, "old_new");
+
+	tree->compare = comp;
+	tree->top = NULL;
+
+	return tree;
+}
+
+static void old_element_free(old_element* element)
+/**********************************************************
+** This void will free the memory allocated for one element
+*/
+{
+	if(element) {
+		if(element->left) old_element_free(element->left);
+		if(element->right) old_element_free(element->right);
+		free(element);
+	}
+}
+
+static void old_free(old_tree* tree)
+/**************************************************************
+** This void will free the memory allocated for the whole tree
+*/
+{
+	old_element_free(tree->top);
+	free(tree);
+}
+
+
+static void old_add(old_tree* tree, void* object)
+/**********************************************************************
+** This void is the core of old_tree.c . It will
+**       1/ add a new element to the tree at the right place
+**          so that the tree remains sorted
+**       2/ balance the tree to be as fast as possible when reading it
+*/
+{
+	old_element* father_of_element;
+	old_element* added_element;
+	old_element* forefather_of_element;
+	old_element* father_of_forefather;
+	HTBool father_found, top_found, first_correction;
+	int depth, depth2;
+	/* father_of_element is a pointer to the structure that is the father of the
+	** new object "object".
+	** added_element is a pointer to the structure that contains or will contain
+	** the new object "object".
+	** father_of_forefather and forefather_of_element are pointers that are used
+	** to modify the depths of upper elements, when needed.
+	**
+	** father_found indicates by a value HT_FALSE when the future father of "object"
+	** is found.
+	** top_found indicates by a value HT_FALSE when, in case of a difference of depths
+	**  < 2, the top of the tree is encountered and forbids any further try to
+	** balance the tree.
+	** first_correction is a boolean used to avoid infinite loops in cases
+	** such as:
+	**
+	**             3                        3
+	**          4                              4
+	**           5                            5
+	**
+	** 3 is used here to show that it need not be the top of the tree.
+	*/
+
+	/*
+	** 1/ Adding of the element to the binary tree
+	*/
+
+	if(!tree->top) {
+		tree->top = malloc(sizeof(old_element));
+		if(!tree->top) HTOOM(__FILE__, "old_add");
+		tree->top->up = NULL;
+		tree->top->object = object;
+		tree->top->left = NULL;
+		tree->top->left_depth = 0;
+		tree->top->right = NULL;
+		tree->top->right_depth = 0;
+	}
+	else {
+		father_found = HT_TRUE;
+		father_of_element = tree->top;
+		added_element = NULL;
+		father_of_forefather = NULL;
+		forefather_of_element = NULL;
+		while(father_found) {
+			if(tree->compare(object, father_of_element->object) < 0) {
+				if(father_of_element->left) {
+					father_of_element = father_of_element->left;
+				}
+				else {
+					father_found = HT_FALSE;
+					father_of_element->left = malloc(sizeof(old_element));
+					if(father_of_element->left == NULL) HTOOM(__FILE__,
+																 "old_add");
+					added_element = father_of_element->left;
+					added_element->up = father_of_element;
+					added_element->object = object;
+					added_element->left = NULL;
+					added_element->left_depth = 0;
+					added_element->right = NULL;
+					added_element->right_depth = 0;
+				}
+			}
+			if(tree->compare(object, father_of_element->object) >= 0) {
+				if(father_of_element->right) {
+					father_of_element = father_of_element->right;
+				}
+				else {
+					father_found = HT_FALSE;
+					father_of_element->right = malloc(sizeof(old_element));
+					if(father_of_element->right == NULL) HTOOM(__FILE__,
+																  "old_add");
+					added_element = father_of_element->right;
+					added_element->up = father_of_element;
+					added_element->object = object;
+					added_element->left = NULL;
+					added_element->left_depth = 0;
+					added_element->right = NULL;
+					added_element->right_depth = 0;
+				}
+			}
+		}
+		/*
+		** Changing of all depths that need to be changed
+		*/
+		father_of_forefather = father_of_element;
+		forefather_of_element = added_element;
+		do {
+			if(father_of_forefather->left == forefather_of_element) {
+				depth = father_of_forefather->left_depth;
+				father_of_forefather->left_depth = 1 +
+												   MAXIMUM(forefather_of_element
+																   ->right_depth,
+														   forefather_of_element
+																   ->left_depth);
+				depth2 = father_of_forefather->left_depth;
+			}
+			else {
+				depth = father_of_forefather->right_depth;
+				father_of_forefather->right_depth = 1 +
+													MAXIMUM(forefather_of_element
+																	->right_depth,
+															forefather_of_element
+																	->left_depth);
+				depth2 = father_of_forefather->right_depth;
+			}
+			forefather_of_element = father_of_forefather;
+			father_of_forefather = father_of_forefather->up;
+		} while((depth != depth2) && (father_of_forefather));
+
+
+		/*
+		** 2/ Balancing the binary tree, if necessary
+		*/
+		top_found = HT_TRUE;
+		first_correction = HT_TRUE;
+		while((top_found) && (first_correction)) {
+			if((abs(
+					father_of_element->left_depth -
+					father_of_element->right_depth)) < 2) {
+				if(father_of_element->up) {
+					father_of_element = father_of_element->up;
+				}
+				else { top_found = HT_FALSE; }
+			}
+			else {                /* We start the process of balancing */
+
+				first_correction = HT_FALSE;
+				/*
+				** first_correction is a boolean used to avoid infinite
+				** loops in cases such as:
+				**
+				**             3                        3
+				**          4                              4
+				**           5                            5
+				**
+				** 3 is used to show that it need not be the top of the tree
+				*/
+
+
+				if(father_of_element->left_depth >
+				   father_of_element->right_depth) {
+					added_element = father_of_element->left;
+					father_of_element->left_depth = added_element->right_depth;
+					added_element->right_depth = 1 + MAXIMUM(father_of_element
+																	 ->right_depth,
+															 father_of_element
+																	 ->left_depth);
+					if(father_of_element->up) {
+						father_of_forefather = father_of_element->up;
+						forefather_of_element = added_element;
+						do {
+							if(father_of_forefather->left ==
+							   forefather_of_element->up) {
+								depth = father_of_forefather->left_depth;
+								father_of_forefather->left_depth = 1 +
+																   MAXIMUM(forefather_of_element
+																				   ->left_depth,
+																		   forefather_of_element
+																				   ->right_depth);
+								depth2 = father_of_forefather->left_depth;
+							}
+							else {
+								depth = father_of_forefather->right_depth;
+								father_of_forefather->right_depth = 1 +
+																	MAXIMUM(forefather_of_element
+																					->left_depth,
+																			forefather_of_element
+																					->right_depth);
+								depth2 = father_of_forefather->right_depth;
+							}
+							forefather_of_element = father_of_forefather;
+							father_of_forefather = father_of_forefather->up;
+						} while((depth != depth2) &&
+								(father_of_forefather));
+						father_of_forefather = father_of_element->up;
+						if(father_of_forefather->left == father_of_element) {
+							/*
+							**                   3                       3
+							**               4                       5
+							** When tree   5   6        becomes    7    4
+							**            7 8                          8 6
+							**
+							** 3 is used to show that it may not be the top of the
+							** tree.
+							*/
+							father_of_forefather->left = added_element;
+							father_of_element->left = added_element->right;
+							added_element->right = father_of_element;
+						}
+						if(father_of_forefather->right == father_of_element) {
+							/*
+							**          3                       3
+							**               4                       5
+							** When tree   5   6        becomes    7    4
+							**            7 8                          8 6
+							**
+							** 3 is used to show that it may not be the top of the
+							** tree
+							*/
+							father_of_forefather->right = added_element;
+							father_of_element->left = added_element->right;
+							added_element->right = father_of_element;
+						}
+						added_element->up = father_of_forefather;
+					}
+					else {
+						/*
+						**
+						**               1                       2
+						** When tree   2   3        becomes    4    1
+						**            4 5                          5 3
+						**
+						** 1 is used to show that it is the top of the tree
+						*/
+						added_element->up = NULL;
+						father_of_element->left = added_element->right;
+						added_element->right = father_of_element;
+					}
+					father_of_element->up = added_element;
+					if(father_of_element->left) {
+						father_of_element->left->up = father_of_element;
+					}
+				}
+				else {
+					added_element = father_of_element->right;
+					father_of_element->right_depth = added_element->left_depth;
+					added_element->left_depth = 1 + MAXIMUM(father_of_element
+																	->right_depth,
+															father_of_element
+																	->left_depth);
+					if(father_of_element->up) {
+						father_of_forefather = father_of_element->up;
+						do {
+							if(father_of_forefather->left ==
+							   father_of_element) {
+								depth = father_of_forefather->left_depth;
+								father_of_forefather->left_depth = 1 +
+																   MAXIMUM(added_element
+																				   ->left_depth,
+																		   added_element
+																				   ->right_depth);
+								depth2 = father_of_forefather->left_depth;
+							}
+							else {
+								depth = father_of_forefather->right_depth;
+								father_of_forefather->right_depth = 1 +
+																	MAXIMUM(added_element
+																					->left_depth,
+																			added_element
+																					->right_depth);
+								depth2 = father_of_forefather->right_depth;
+							}
+							father_of_forefather = father_of_forefather->up;
+						} while((depth != depth2) &&
+								(father_of_forefather));
+						father_of_forefather = father_of_element->up;
+						if(father_of_forefather->left == father_of_element) {
+							/*
+							**                    3                       3
+							**               4                       6
+							** When tree   5   6        becomes    4    8
+							**                7 8                 5 7
+							**
+							** 3 is used to show that it may not be the top of the
+							** tree.
+							*/
+							father_of_forefather->left = added_element;
+							father_of_element->right = added_element->left;
+							added_element->left = father_of_element;
+						}
+						if(father_of_forefather->right == father_of_element) {
+							/*
+							**           3                      3
+							**               4                       6
+							** When tree   5   6        becomes    4    8
+							**                7 8                 5 7
+							**
+							** 3 is used to show that it may not be the top of the
+							** tree
+							*/
+							father_of_forefather->right = added_element;
+							father_of_element->right = added_element->left;
+							added_element->left = father_of_element;
+						}
+						added_element->up = father_of_forefather;
+					}
+					else {
+						/*
+						**
+						**               1                       3
+						** When tree   2   3        becomes    1    5
+						**                4 5                 2 4
+						**
+						** 1 is used to show that it is the top of the tree.
+						*/
+						added_element->up = NULL;
+						father_of_element->right = added_element->left;
+						added_element->left = father_of_element;
+					}
+					father_of_element->up = added_element;
+					if(father_of_element->right) {
+						father_of_element->right->up = father_of_element;
+					}
+				}
+			}
+		}
+		while(father_of_element->up) {
+			father_of_element = father_of_element->up;
+		}
+		tree->top = father_of_element;
+	}
+}
+
+
+static old_element* old_next(old_tree* tree, old_element* ele)
+/**************************************************************************
+** this function returns a pointer to the leftmost element if ele is NULL,
+** and to the next object to the right otherways.
+** If no elements left, returns a pointer to NULL.
+*/
+{
+	old_element* father_of_element;
+	old_element* father_of_forefather;
+
+	if(ele == NULL) {
+		father_of_element = tree->top;
+		if(father_of_element) {
+			while(father_of_element->left)
+				father_of_element = father_of_element->left;
+		}
+	}
+	else {
+		father_of_element = ele;
+		if(father_of_element->right) {
+			father_of_element = father_of_element->right;
+			while(father_of_element->left)
+				father_of_element = father_of_element->left;
+		}
+		else {
+			father_of_forefather = father_of_element->up;
+			while(father_of_forefather &&
+				  (father_of_forefather->right == father_of_element)) {
+				father_of_element = father_of_forefather;
+				father_of_forefather = father_of_element->up;
+			}
+			father_of_element = father_of_forefather;
+		}
+	}
+	return father_of_element;
+}
+
+
+/*	Made up file names
+**	------------------
+*/
+static unsigned long seed = 7;
+
+static int random_below(int n) {
+	seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	return (int) ((seed >> 8) % (unsigned long) n);
+}
+
+static const char* words[] = {
+		"README", "Makefile", "index", "Overview", "HTTP", "Status", "FAQ",
+		"image", "icon", "paper", "talk", "core", "patch", "Library", "src" };
+#define WORDS ((int) (sizeof(words) / sizeof(words[0])))
+
+static const char* suffixes[] = {
+		"", ".html", ".txt", ".gif", ".Z", ".tar", ".c", ".h" };
+#define SUFFIXES ((int) (sizeof(suffixes) / sizeof(suffixes[0])))
+
+static char* make_name(void) {
+	static char buffer[64];
+	char* name;
+	char* p;
+
+	if(*buffer && random_below(8) == 0) {    /* Last name in other case */
+		for(p = buffer; *p; p++) {
+			*p = (char) (isupper(*p) ? tolower(*p) : toupper(*p));
+		}
+	}
+	else {
+		sprintf(
+				buffer, "%s%d%s", words[random_below(WORDS)],
+				random_below(1000000), suffixes[random_below(SUFFIXES)]);
+	}
+	name = malloc(strlen(buffer) + 1);
+	if(!name) HTOOM(__FILE__, "make_name");
+	strcpy(name, buffer);
+	return name;
+}
+
+
+/*	The old tree in a child process
+**	-------------------------------
+**
+**	Prints its time per round and exits 0 if its order agrees with
+**	HTBTree's, 1 if not.
+*/
+static void run_old(char** names, int n, int rounds) {
+	void** order = malloc(n * sizeof(void*));
+	HTBTree* tree;
+	HTBTElement* ele;
+	double t;
+	int i, round;
+
+	if(!order) HTOOM(__FILE__, "run_old");
+	t = now();
+	for(round = 0; round < rounds; round++) {
+		old_tree* old = old_new(HTBTree_caseCompare);
+		old_element* old_ele;
+
+		for(i = 0; i < n; i++) old_add(old, names[i]);
+		for(old_ele = old_next(old, NULL), i = 0; old_ele;
+				old_ele = old_next(old, old_ele)) {
+			order[i++] = old_ele->object;
+		}
+		old_free(old);
+	}
+	printf("%9.2f ms old,", (now() - t) / rounds * 1e3);
+
+	tree = HTBTree_new(HTBTree_caseCompare);
+	for(i = 0; i < n; i++) HTBTree_add(tree, names[i]);
+	for(ele = HTBTree_next(tree, NULL), i = 0; ele;
+			ele = HTBTree_next(tree, ele), i++) {
+		if(HTBTree_object(ele) != order[i]) {
+			printf(
+					"\nold has %s at %d, new %s\n", (char*) order[i], i,
+					(char*) HTBTree_object(ele));
+			exit(1);
+		}
+	}
+	exit(0);
+}
+
+
+int main(void) {
+	char** names = malloc(MAX_NAMES * sizeof(char*));
+	double t;
+	int n, i, round, rounds, status;
+	HTBool agree = HT_TRUE;
+
+	if(!names) HTOOM(__FILE__, "main");
+	for(i = 0; i < MAX_NAMES; i++) names[i] = make_name();
+
+	for(n = 1000; n <= MAX_NAMES; n *= 10) {
+		pid_t pid;
+
+		rounds = n < 100000 ? 100000 / n : 1;
+
+		printf("%7d names: ", n);
+		fflush(stdout);
+		pid = fork();
+		if(pid == 0) run_old(names, n, rounds);
+		if(pid < 0 || waitpid(pid, &status, 0) < 0) {
+			perror("fork");
+			return 2;
+		}
+		if(WIFSIGNALED(status)) printf("  crashed old,");
+		else if(WEXITSTATUS(status)) agree = HT_FALSE;
+
+		t = now();
+		for(round = 0; round < rounds; round++) {
+			HTBTree* tree = HTBTree_new(HTBTree_caseCompare);
+			HTBTElement* ele;
+
+			for(i = 0; i < n; i++) HTBTree_add(tree, names[i]);
+			for(ele = HTBTree_next(tree, NULL); ele;
+					ele = HTBTree_next(tree, ele)) { }
+			HTBTree_free(tree);
+		}
+		printf(" %9.2f ms new\n", (now() - t) / rounds * 1e3);
+	}
+	printf(agree ? "Old and new agree\n" : "Old and new differ\n");
+	return agree ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/*		Test of the Content-Encoding decoder		HTInflateTest.c
+**		====================================
+**
+**	Compresses a body as gzip, zlib and raw deflate, then feeds each to
+**	HTInflate whole and a character at a time, and checks that the
+**	body comes out. Raw deflate fed a character at a time is what HTMIME
+**	does with a body from a server which sends "deflate" without the
+**	zlib header.
+**
+**	From Library/Implementation:
+**
+**	cc -DGOT_ZLIB -I. -o /tmp/HTInflateTest ../Test/HTInflateTest.c \
+**		HTInflate.c HTAtom.c HTString.c -lz && /tmp/HTInflateTest
+**
+**	Exits 0 if all is well.
+*/
+
+#include <HTInflate.h>
+
+#include <HTSTD.h>
+
+#include <zlib.h>
+
+#define BODY_SIZE 100000
+
+struct _HTStream {
+	const HTStreamClass* isa;
+	char* data;
+	int length;
+	HTBool freed;
+};
+
+void HTOOM(const char* file, const char* func) {
+	fprintf(stderr, "%s: %s: Out of memory\n", file, func);
+	exit(2);
+}
+
+static void sink_block(HTStream* me, const char* s, int l) {
+	if(me->length + l > BODY_SIZE) return;
+	memcpy(me->data + me->length, s, (size_t) l);
+	me->length += l;
+}
+
+static void sink_character(HTStream* me, char c) {
+	sink_block(me, &c, 1);
+}
+
+static void sink_string(HTStream* me, const char* s) {
+	sink_block(me, s, (int) strlen(s));
+}
+
+static void sink_free(HTStream* me) {
+	me->freed = HT_TRUE;
+}
+
+static void sink_abort(HTStream* me, HTError e) {
+	(void) e;
+	me->freed = HT_TRUE;
+}
+
+static const HTStreamClass sink_class = {
+		"Test sink", sink_free, sink_abort, sink_character, sink_string,
+		sink_block, NULL };
+
+
+/*	Compress with window bits as for deflateInit2
+*/
+static int compress_body(
+		const char* body, int length, int bits, char* out, int size) {
+	z_stream z;
+
+	memset(&z, 0, sizeof(z));
+	if(deflateInit2(&z, 6, Z_DEFLATED, bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return -1;
+	}
+	z.next_in = (Bytef*) body;
+	z.avail_in = (uInt) length;
+	z.next_out = (Bytef*) out;
+	z.avail_out = (uInt) size;
+	if(deflate(&z, Z_FINISH) != Z_STREAM_END) return -1;
+	deflateEnd(&z);
+	return (int) z.total_out;
+}
+
+static int check(
+		const char* name, HTEncoding encoding, const char* body, int length,
+		const char* encoded, int encoded_length, HTBool by_character) {
+	char* data = malloc(BODY_SIZE);
+	HTStream sink;
+	HTStream* stream;
+	int ok;
+
+	sink.isa = &sink_class;
+	sink.data = data;
+	sink.length = 0;
+	sink.freed = HT_FALSE;
+	stream = HTInflate(encoding, &sink);
+	if(by_character) {
+		int i;
+		for(i = 0; i < encoded_length; i++) {
+			(*stream->isa->put_character)(stream, encoded[i]);
+		}
+	}
+	else {
+		(*stream->isa->put_block)(stream, encoded, encoded_length);
+	}
+	(*stream->isa->free)(stream);
+
+	ok = sink.freed && sink.length == length &&
+		 0 == memcmp(data, body, (size_t) length);
+	printf(
+			"%-8s %-12s %6d bytes in, %6d out: %s\n", name,
+			by_character ? "by character" : "whole", encoded_length,
+			sink.length, ok ? "ok" : "FAILED");
+	free(data);
+	return ok;
+}
+
+int main(void) {
+	static const struct {
+		const char* name;
+		int bits;
+	} formats[] = {
+			{ "gzip",    MAX_WBITS + 16 },
+			{ "zlib",    MAX_WBITS },
+			{ "raw",     -MAX_WBITS } };
+	char* body = malloc(BODY_SIZE);
+	char* encoded = malloc(BODY_SIZE + 1000);
+	int failures = 0;
+	int i;
+
+	for(i = 0; i < BODY_SIZE; i++) {    /* Compressible, but not too */
+		body[i] = "<p>Hypertext links </a>\n"[i % 24] + (char) (i / 997 % 3);
+	}
+	for(i = 0; i < (int) (sizeof(formats) / sizeof(formats[0])); i++) {
+		HTEncoding encoding = formats[i].bits > MAX_WBITS ?
+							  WWW_ENC_GZIP : WWW_ENC_DEFLATE;
+		int length = compress_body(
+				body, BODY_SIZE, formats[i].bits, encoded, BODY_SIZE + 1000);
+
+		if(length < 0) {
+			printf("%s: deflate failed\n", formats[i].name);
+			failures++;
+			continue;
+		}
+		if(!check(formats[i].name, encoding, body, BODY_SIZE, encoded,
+				length, HT_FALSE)) failures++;
+		if(!check(formats[i].name, encoding, body, BODY_SIZE, encoded,
+				length, HT_TRUE)) failures++;
+	}
+	free(body);
+	free(encoded);
+	return failures ? 1 : 0;
+}
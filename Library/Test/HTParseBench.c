@@ -0,0 +1,272 @@
+/*		Benchmark of URL simplifying and escaping	HTParseBench.c
+**		=========================================
+**
+**	Times HTSimplify, HTEscape and HTUnEscape against the versions they
+**	replaced, copied here as old_simplify (with memmove for its
+**	overlapping strcpy), old_escape and old_unescape. The URLs are read
+**	one a line from the file named as the argument, or else made up:
+**	CERN-style hrefs, some absolute, some with queries and anchors, and
+**	with "dotted" as the argument a good share of "." and ".." segments.
+**	Then long dotted paths, which old_simplify takes quadratic time
+**	over, and a long run of safe characters.
+**
+**	From Library/Implementation:
+**
+**	cc -O2 -I. -o /tmp/HTParseBench ../Test/HTParseBench.c HTParse.c \
+**		HTString.c && /tmp/HTParseBench [dotted | file]
+**
+**	HTParse.c needs HTOOM from the application, so it is given here.
+*/
+
+#include <HTParse.h>
+
+#include <HTSTD.h>
+
+#define URLS 20000
+#define ROUNDS 5
+#define HEX_ESCAPE '%'
+
+void HTOOM(const char* file, const char* func) {
+	fprintf(stderr, "%s: %s: Out of memory\n", file, func);
+	exit(2);
+}
+
+static double now(void) {
+	struct timeval t;
+	gettimeofday(&t, 0);
+	return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+
+/*	The replaced versions
+**	---------------------
+*/
+static void old_simplify(char* filename) {
+	char* p;
+	char* q;
+	if(filename[0] && filename[1]) {
+		for(p = filename + 2; *p; p++) {
+			if(*p == '/') {
+				if((p[1] == '.') && (p[2] == '.') && (p[3] == '/' || !p[3])) {
+					for(q = p - 1; (q >= filename) && (*q != '/'); q--) { }
+					if(q[0] == '/' && 0 != strncmp(q, "/../", 4) &&
+					   !(q - 1 > filename && q[-1] == '/')) {
+						memmove(q, p + 3, strlen(p + 3) + 1);
+						if(!*filename) strcpy(filename, "/");
+						p = q - 1;
+					}
+				}
+				else if((p[1] == '.') && (p[2] == '/' || !p[2])) {
+					memmove(p, p + 2, strlen(p + 2) + 1);
+				}
+			}
+		}
+	}
+}
+
+static const unsigned char old_acceptable[96] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 7, 6, 0, 7, 7, 4,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 0, 0, 0, 0, 0, 0,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 0, 0, 0, 0, 7,
+		0, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 0, 0, 0, 0, 0 };
+
+#define OLD_ACCEPTABLE(a) \
+	((a) >= 32 && (a) < 128 && (old_acceptable[(a) - 32] & mask))
+
+static char* old_escape(const char* str, unsigned char mask) {
+	static const char* hex = "0123456789ABCDEF";
+	const char* p;
+	char* q;
+	char* result;
+	int unacceptable = 0;
+	for(p = str; *p; p++) {
+		if(!OLD_ACCEPTABLE((unsigned char) (*p))) unacceptable++;
+	}
+	result = malloc(p - str + unacceptable + unacceptable + 1);
+	if(result == NULL) HTOOM(__FILE__, "old_escape");
+	for(q = result, p = str; *p; p++) {
+		unsigned char a = (*p);
+		if(!OLD_ACCEPTABLE(a)) {
+			*q++ = HEX_ESCAPE;
+			*q++ = hex[a >> 4];
+			*q++ = hex[a & 15];
+		}
+		else *q++ = *p;
+	}
+	*q++ = 0;
+	return result;
+}
+
+static char from_hex(char c) {
+	return c >= '0' && c <= '9' ? c - '0' :
+		   c >= 'A' && c <= 'F' ? c - 'A' + 10 : c - 'a' + 10;
+}
+
+static char* old_unescape(char* str) {
+	char* p = str;
+	char* q = str;
+	while(*p) {
+		if(*p == HEX_ESCAPE) {
+			p++;
+			if(*p) *q = from_hex(*p++) * 16;
+			if(*p) *q = (*q + from_hex(*p++));
+			q++;
+		}
+		else *q++ = *p++;
+	}
+	*q++ = 0;
+	return str;
+}
+
+
+/*	Made up URLs
+**	------------
+*/
+static unsigned long seed = 7;
+
+static int random_below(int n) {
+	seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	return (int) ((seed >> 8) % (unsigned long) n);
+}
+
+static const char* words[] = {
+		"www", "hypertext", "WWW", "Library", "Implementation", "docs",
+		"index.html", "Status.html", "FAQ", "images", "icons", "people",
+		"~timbl", "Protocols", "HTTP", "HTRQ_Headers.html", "Overview.html",
+		"src", "cgi-bin", "search", "Copyright.html", "README", "1994", "Jan",
+		"papers", "Caf\351", "a b" };
+#define WORDS ((int) (sizeof(words) / sizeof(words[0])))
+
+static void make_url(char* s, HTBool dotted) {
+	int segments = 2 + random_below(6);
+	int i;
+
+	if(random_below(3) == 0) s += sprintf(s, "http://info.cern.ch");
+	for(i = 0; i < segments; i++) {
+		int r = random_below(dotted ? 4 : 12);
+		s += sprintf(s, "/%s", r == 0 ? ".." : r == 1 ? "." :
+							   words[random_below(WORDS)]);
+	}
+	if(random_below(5) == 0) {
+		s += sprintf(
+				s, "?%s %s&x=%d", words[random_below(WORDS)],
+				words[random_below(WORDS)], random_below(1000));
+	}
+	if(random_below(6) == 0) sprintf(s, "#%s", words[random_below(WORDS)]);
+}
+
+static int read_urls(const char* filename, char** urls) {
+	FILE* fp = fopen(filename, "r");
+	char line[1024];
+	int n = 0;
+
+	if(!fp) return -1;
+	while(n < URLS && fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\r\n")] = 0;
+		if(!*line) continue;
+		urls[n] = malloc(strlen(line) + 1);
+		strcpy(urls[n++], line);
+	}
+	fclose(fp);
+	return n;
+}
+
+
+int main(int argc, char** argv) {
+	static char* urls[URLS];
+	static char* escaped[URLS];
+	double t, old_time, new_time;
+	char buffer[4096];
+	long total = 0;
+	int n, i, round, length;
+	HTBool dotted = argc > 1 && 0 == strcmp(argv[1], "dotted");
+
+	if(argc > 1 && !dotted) {
+		n = read_urls(argv[1], urls);
+		if(n <= 0) {
+			fprintf(stderr, "Can't read URLs from %s\n", argv[1]);
+			return 1;
+		}
+	}
+	else {
+		for(n = 0; n < URLS; n++) {
+			make_url(buffer, dotted);
+			urls[n] = malloc(strlen(buffer) + 1);
+			strcpy(urls[n], buffer);
+		}
+	}
+	for(i = 0; i < n; i++) {
+		total += (long) strlen(urls[i]);
+		escaped[i] = HTEscape(urls[i], URL_PATH);
+	}
+	printf("%d URLs, mean %.1f bytes\n", n, (double) total / n);
+
+#define TIME(result, body) \
+	t = now(); \
+	for(round = 0; round < ROUNDS; round++) { \
+		for(i = 0; i < n; i++) { body; } \
+	} \
+	result = (now() - t) / ROUNDS / n * 1e9
+
+	TIME(old_time, strcpy(buffer, urls[i]); old_simplify(buffer));
+	TIME(new_time, strcpy(buffer, urls[i]); HTSimplify(buffer));
+	printf("HTSimplify %8.1f ns old, %8.1f ns new\n", old_time, new_time);
+	TIME(old_time, free(old_escape(urls[i], URL_PATH)));
+	TIME(new_time, free(HTEscape(urls[i], URL_PATH)));
+	printf("HTEscape   %8.1f ns old, %8.1f ns new\n", old_time, new_time);
+	TIME(old_time, strcpy(buffer, escaped[i]); old_unescape(buffer));
+	TIME(new_time, strcpy(buffer, escaped[i]); HTUnEscape(buffer));
+	printf("HTUnEscape %8.1f ns old, %8.1f ns new\n", old_time, new_time);
+
+	for(length = 1000; length <= 64000; length *= 4) {
+		char* path = malloc(length + 8);
+		char* copy = malloc(length + 8);
+
+		for(i = 0; i + 5 < length; i += 5) {
+			memcpy(path + i, i % 10 ? "/../." : "/aaaa", 5);
+		}
+		path[i] = 0;
+		strcpy(copy, path);
+		t = now();
+		old_simplify(copy);
+		old_time = now() - t;
+		strcpy(copy, path);
+		t = now();
+		HTSimplify(copy);
+		new_time = now() - t;
+		printf(
+				"HTSimplify of %5d dotted bytes %10.1f us old, %7.1f us new\n",
+				length, old_time * 1e6, new_time * 1e6);
+		free(path);
+		free(copy);
+	}
+
+	{
+		char* safe = malloc(65537);
+
+		memset(safe, 'a', 65536);
+		safe[65536] = 0;
+		t = now();
+		for(i = 0; i < 100; i++) free(old_escape(safe, URL_PATH));
+		old_time = (now() - t) / 100;
+		t = now();
+		for(i = 0; i < 100; i++) free(HTEscape(safe, URL_PATH));
+		new_time = (now() - t) / 100;
+		printf(
+				"HTEscape of 64k safe bytes %7.1f us old, %7.1f us new\n",
+				old_time * 1e6, new_time * 1e6);
+		t = now();
+		for(i = 0; i < 100; i++) old_unescape(safe);
+		old_time = (now() - t) / 100;
+		t = now();
+		for(i = 0; i < 100; i++) HTUnEscape(safe);
+		new_time = (now() - t) / 100;
+		printf(
+				"HTUnEscape of 64k safe bytes %7.1f us old, %7.1f us new\n",
+				old_time * 1e6, new_time * 1e6);
+		free(safe);
+	}
+	return 0;
+}
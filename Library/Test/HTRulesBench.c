@@ -0,0 +1,216 @@
+/*		Benchmark of rule matching			HTRulesBench.c
+**		==========================
+**
+**	Makes a rule file's worth of map, pass and fail rules for distinct
+**	prefixes, as many as the argument says (3000 if none), with a pass
+**	and a fail for everything at the end. Then times HTTranslate on
+**	10000 distinct URLs against old_translate, the walk over every rule
+**	which it replaced, copied here, and checks that they agree. Last it
+**	times 100 URLs over and over, which the translation cache answers.
+**
+**	From Library/Implementation:
+**
+**	cc -O2 -I. -o /tmp/HTRulesBench ../Test/HTRulesBench.c HTRules.c \
+**		HTParse.c HTString.c && /tmp/HTRulesBench [rules]
+**
+**	HTRules.c calls HTSetSuffix and HTSetPresentation for configuration
+**	lines not used here. Dummies of them are given here, with HTOOM,
+**	rather than bringing in HTFile.c and HTFormat.c.
+*/
+
+#include <HTRules.h>
+
+#include <HTSTD.h>
+#include <HTFile.h>
+
+#define URLS 10000
+#define REPEATS 100000
+
+void HTOOM(const char* file, const char* func) {
+	fprintf(stderr, "%s: %s: Out of memory\n", file, func);
+	exit(2);
+}
+
+void HTSetSuffix(
+		const char* suffix, const char* representation, const char* encoding,
+		double quality) {
+	(void) suffix;
+	(void) representation;
+	(void) encoding;
+	(void) quality;
+}
+
+void HTSetPresentation(
+		const char* representation, const char* command, double quality,
+		double secs, double secs_per_byte) {
+	(void) representation;
+	(void) command;
+	(void) quality;
+	(void) secs;
+	(void) secs_per_byte;
+}
+
+static double now(void) {
+	struct timeval t;
+	gettimeofday(&t, 0);
+	return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+
+/*	The rules walked as before
+**	--------------------------
+*/
+typedef struct {
+	HTRuleOp op;
+	char* pattern;
+	char* equiv;
+} old_rule;
+
+static old_rule* old_rules;
+static int old_count;
+
+static void old_add(HTRuleOp op, const char* pattern, const char* equiv) {
+	old_rule* r = &old_rules[old_count++];
+
+	r->op = op;
+	r->pattern = malloc(strlen(pattern) + 1);
+	strcpy(r->pattern, pattern);
+	r->equiv = 0;
+	if(equiv) {
+		r->equiv = malloc(strlen(equiv) + 1);
+		strcpy(r->equiv, equiv);
+	}
+}
+
+static char* old_translate(const char* required) {
+	char* current = malloc(strlen(required) + 1);
+	int i;
+
+	strcpy(current, required);
+	for(i = 0; i < old_count; i++) {
+		old_rule* r = &old_rules[i];
+		const char* p = r->pattern;
+		const char* q = current;
+		int m = 0;
+
+		for(; *p && *q; p++, q++) {
+			if(*p != *q) break;
+		}
+		if(*p == '*') {
+			m = (int) (strlen(q) - strlen(p + 1));
+			if(m < 0) continue;
+			if(0 != strcmp(q + m, p + 1)) continue;
+		}
+		else if(*p != *q) continue;
+
+		if(r->op == HT_Fail || r->op == HT_Invalid) {
+			free(current);
+			return 0;
+		}
+		if(r->op == HT_Pass && !r->equiv) return current;
+		if(*p == *q) {
+			free(current);
+			current = malloc(strlen(r->equiv) + 1);
+			strcpy(current, r->equiv);
+		}
+		else {
+			const char* ins = strchr(r->equiv, '*');
+			char* temp = malloc(strlen(r->equiv) + m + 1);
+
+			if(ins) {
+				memcpy(temp, r->equiv, ins - r->equiv);
+				memcpy(temp + (ins - r->equiv), q, (size_t) m);
+				strcpy(temp + (ins - r->equiv) + m, ins + 1);
+			}
+			else strcpy(temp, r->equiv);
+			free(current);
+			current = temp;
+		}
+		if(r->op == HT_Pass) return current;
+	}
+	return current;
+}
+
+
+/*	Both sets of rules
+*/
+static void add(
+		HTRuleSet* set, HTRuleOp op, const char* pattern, const char* equiv) {
+	HTRuleSet_add(set, op, pattern, equiv);
+	old_add(op, pattern, equiv);
+}
+
+int main(int argc, char** argv) {
+	static char urls[URLS][64];
+	int count = argc > 1 ? atoi(argv[1]) : 3000;
+	HTRuleSet* set = HTRuleSet_new();
+	char pattern[64], equiv[64];
+	double t, old_time, new_time;
+	unsigned long seed = 7;
+	int i;
+
+	if(count < 3) count = 3;
+	old_rules = malloc((count + 2) * sizeof(old_rule));
+	for(i = 0; i < count; i++) {
+		switch(i % 3) {
+			case 0: sprintf(pattern, "/project%d/*", i);
+				sprintf(equiv, "/usr/local/www/p%d/*", i);
+				add(set, HT_Map, pattern, equiv);
+				break;
+			case 1: sprintf(pattern, "/pub%d/*", i);
+				add(set, HT_Pass, pattern, 0);
+				break;
+			default: sprintf(pattern, "/private%d/*", i);
+				add(set, HT_Fail, pattern, 0);
+				break;
+		}
+	}
+	add(set, HT_Pass, "/usr/local/www/*", 0);
+	add(set, HT_Fail, "*", 0);
+
+	t = now();
+	HTRuleSet_publish(set);
+	printf(
+			"%d rules, indexed in %.1f ms\n", old_count,
+			(now() - t) * 1e3);
+
+	for(i = 0; i < URLS; i++) {
+		int r;
+		seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+		r = (int) ((seed >> 8) % (unsigned long) count);
+		sprintf(
+				urls[i], "/%s%d/dir/file%d.html",
+				r % 3 == 0 ? "project" : r % 3 == 1 ? "pub" : "private", r, i);
+	}
+
+	t = now();
+	for(i = 0; i < URLS; i++) free(old_translate(urls[i]));
+	old_time = (now() - t) / URLS;
+	t = now();
+	for(i = 0; i < URLS; i++) free(HTTranslate(urls[i]));
+	new_time = (now() - t) / URLS;
+	printf(
+			"%d distinct URLs: %.2f us old, %.2f us new per translation\n",
+			URLS, old_time * 1e6, new_time * 1e6);
+
+	t = now();
+	for(i = 0; i < REPEATS; i++) free(HTTranslate(urls[i % 100]));
+	printf(
+			"100 URLs repeated: %.3f us per translation\n",
+			(now() - t) / REPEATS * 1e6);
+
+	for(i = 0; i < URLS; i++) {
+		char* a = old_translate(urls[i]);
+		char* b = HTTranslate(urls[i]);
+		if((a == 0) != (b == 0) || (a && strcmp(a, b))) {
+			printf(
+					"%s: old gives %s, new %s\n", urls[i], a ? a : "fail",
+					b ? b : "fail");
+			return 1;
+		}
+		free(a);
+		free(b);
+	}
+	printf("Old and new agree\n");
+	return 0;
+}